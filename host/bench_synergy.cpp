@@ -0,0 +1,293 @@
+/**
+ * Synergy decoder replay benchmark (host)
+ * Feeds synthetic mouse-heavy, typing-heavy and clipboard-heavy Synergy
+ * streams through SynergyClient::update() from memory and reports ns/message,
+ * messages/sec and the heap allocations the decode path makes.
+ *
+ *   bench_synergy [--passes N] [--check] [--max-ns N]
+ *
+ * --check fails (exit 1) if decoding allocates at all; --max-ns fails if any
+ * trace costs more than N ns per message. Both are meant for CI gates.
+ */
+
+#include "../include/synergy_protocol.h"
+#include "replay_client.h"
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Allocation counting: every operator new, and on glibc every malloc family
+// call, made while _counting is set
+static std::atomic<bool> _counting(false);
+static std::atomic<uint32_t> _allocations(0);
+
+static inline void countAllocation() {
+    if (_counting.load(std::memory_order_relaxed)) _allocations++;
+}
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+
+void* malloc(size_t size) {
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    countAllocation();
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) {
+    countAllocation();
+    return __libc_realloc(p, size);
+}
+}
+// operator new below goes through the counted malloc
+static inline void* allocate(size_t size) { return malloc(size ? size : 1); }
+#else
+static inline void* allocate(size_t size) {
+    countAllocation();
+    return malloc(size ? size : 1);
+}
+#endif
+
+void* operator new(size_t size) {
+    void* p = allocate(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static const size_t TRACE_CAPACITY = 32 * 1024;
+
+// Big-endian frame builder over a fixed buffer
+struct TraceWriter {
+    uint8_t* buf;
+    size_t len;
+    size_t frameStart;
+
+    size_t room() const { return TRACE_CAPACITY - len; }
+    void u8(uint8_t v) { buf[len++] = v; }
+    void u16(uint16_t v) { u8(v >> 8); u8(v); }
+    void u32(uint32_t v) { u16(v >> 16); u16(v); }
+    void bytes(const void* data, size_t n) { memcpy(buf + len, data, n); len += n; }
+    void begin(const char* cmd) { frameStart = len; len += 4; bytes(cmd, strlen(cmd)); }
+    void end() {
+        uint32_t body = (uint32_t)(len - frameStart - 4);
+        buf[frameStart] = body >> 24;
+        buf[frameStart + 1] = body >> 16;
+        buf[frameStart + 2] = body >> 8;
+        buf[frameStart + 3] = body;
+    }
+};
+
+static void writeHandshake(TraceWriter& w) {
+    w.begin("Synergy");
+    w.u16(SYNERGY_PROTOCOL_MAJOR);
+    w.u16(SYNERGY_PROTOCOL_MINOR);
+    w.end();
+}
+
+// Fast sweeps with the odd wheel tick
+static void buildMouse(TraceWriter& w) {
+    for (uint32_t i = 0; w.room() >= 16; i++) {
+        if ((i & 15) == 15) {
+            w.begin("DMWM");
+            w.u16(0); w.u16(120);
+        } else {
+            w.begin("DMMV");
+            w.u16(i % 1920); w.u16((i * 3) % 1080);
+        }
+        w.end();
+    }
+}
+
+// Key down/up pairs with periodic keep-alives
+static void buildTyping(TraceWriter& w) {
+    for (uint32_t i = 0; w.room() >= 48; i++) {
+        uint16_t button = 0x10 + (i % 0x23);
+        w.begin("DKDN");
+        w.u16(0); w.u16(0); w.u16(button);
+        w.end();
+        w.begin("DKUP");
+        w.u16(0); w.u16(0); w.u16(button);
+        w.end();
+        if ((i & 7) == 7) {
+            w.begin("CALV");
+            w.end();
+        }
+    }
+}
+
+// One text clipboard in 4 KB chunks, with mouse moves between chunks
+static void buildClipboard(TraceWriter& w) {
+    static const uint32_t CHUNK = 4096;
+    static const uint32_t TEXT_LEN = 24 * 1024;
+
+    w.begin("DCLP");
+    w.u8(0); w.u32(1); w.u8(1); // id, sequence, mark = start
+    w.u32(0);                   // empty size string
+    w.end();
+
+    // Serialized clipboard: count, then format/size/data per format
+    uint32_t serialLen = 12 + TEXT_LEN;
+    uint32_t sent = 0;
+    for (uint32_t n = 0; sent < serialLen; n++) {
+        uint32_t take = serialLen - sent;
+        if (take > CHUNK) take = CHUNK;
+        w.begin("DCLP");
+        w.u8(0); w.u32(1); w.u8(2); // id, sequence, mark = chunk
+        w.u32(take);
+        for (uint32_t i = 0; i < take; i++, sent++) {
+            if (sent < 4) w.u8(sent == 3 ? 1 : 0);      // count = 1
+            else if (sent < 8) w.u8(0);                 // format = text
+            else if (sent < 12) w.u8((uint8_t)(TEXT_LEN >> (8 * (11 - sent))));
+            else w.u8('a' + (sent % 26));
+        }
+        w.end();
+        w.begin("DMMV");
+        w.u16(n * 10); w.u16(n * 10);
+        w.end();
+    }
+
+    w.begin("DCLP");
+    w.u8(0); w.u32(1); w.u8(3); // mark = end
+    w.u32(0);
+    w.end();
+}
+
+// Callbacks only count, so the numbers reflect the decoder alone
+static volatile uint32_t _callbacks = 0;
+
+static void benchMouse(int16_t, int16_t, int16_t, int16_t, bool, bool, bool) { _callbacks++; }
+static void benchKeyboard(uint16_t, uint16_t, uint16_t, bool, bool) { _callbacks++; }
+static void benchScreen(bool) { _callbacks++; }
+static void benchClipboard(uint8_t, const uint8_t*, size_t, bool) { _callbacks++; }
+
+struct Result {
+    const char* trace;
+    uint32_t messages;    // Frames decoded per pass (from SynergyClient stats)
+    uint32_t bytes;       // Bytes fed per pass (after the hello)
+    uint64_t elapsedNs;   // Total across passes
+    uint32_t nsPerMessage;
+    uint32_t messagesPerSec;
+    uint32_t allocations; // Made by the decode path during the timed passes
+};
+
+static Result run(const char* trace, void (*build)(TraceWriter&), uint32_t passes) {
+    // The hello is replayed before each pass but not measured: it happens
+    // once per connection, not per input event
+    static uint8_t helloBuf[64];
+    TraceWriter hw = { helloBuf, 0, 0 };
+    writeHandshake(hw);
+    static uint8_t buf[TRACE_CAPACITY];
+    TraceWriter w = { buf, 0, 0 };
+    build(w);
+
+    static synergy::SynergyClient synergy;
+    synergy.setMouseCallback(benchMouse);
+    synergy.setKeyboardCallback(benchKeyboard);
+    synergy.setScreenActiveCallback(benchScreen);
+    synergy.setClipboardCallback(benchClipboard);
+    uint32_t messagesBefore = synergy.stats().messages;
+
+    ReplayClient helloClient(helloBuf, hw.len);
+    ReplayClient client(buf, w.len);
+
+    _allocations = 0;
+    std::chrono::steady_clock::duration elapsed(0);
+    for (uint32_t p = 0; p < passes; p++) {
+        synergy.resetState();
+        helloClient.rewind();
+        synergy.update(helloClient);
+
+        client.rewind();
+        _counting = true;
+        auto start = std::chrono::steady_clock::now();
+        while (!client.done()) {
+            synergy.update(client);
+        }
+        synergy.update(client); // Frames completed by the last read
+        elapsed += std::chrono::steady_clock::now() - start;
+        _counting = false;
+    }
+
+    Result r;
+    r.trace = trace;
+    r.messages = (synergy.stats().messages - messagesBefore) / passes - 1;  // Less the hello
+    r.bytes = (uint32_t)w.len;
+    r.elapsedNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    uint64_t totalMessages = (uint64_t)r.messages * passes;
+    r.nsPerMessage = totalMessages ? (uint32_t)(r.elapsedNs / totalMessages) : 0;
+    r.messagesPerSec = r.elapsedNs ? (uint32_t)(totalMessages * 1000000000ULL / r.elapsedNs) : 0;
+    r.allocations = _allocations;
+    return r;
+}
+
+int main(int argc, char** argv) {
+    uint32_t passes = 200;
+    bool check = false;
+    uint32_t maxNs = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc) passes = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--max-ns") == 0 && i + 1 < argc) maxNs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--check") == 0) check = true;
+        else {
+            fprintf(stderr, "usage: %s [--passes N] [--check] [--max-ns N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (passes == 0) passes = 1;
+
+    static const struct {
+        const char* name;
+        void (*build)(TraceWriter&);
+    } TRACES[] = {
+        { "mouse", buildMouse },
+        { "typing", buildTyping },
+        { "clipboard", buildClipboard },
+    };
+
+    printf("Synergy decoder replay, %u passes\n", (unsigned)passes);
+    printf("trace      msgs/pass  bytes/pass  ns/msg  msgs/sec  allocs\n");
+    int status = 0;
+    for (const auto& t : TRACES) {
+        Result r = run(t.name, t.build, passes);
+        printf("%-10s %9u %11u %7u %9u %7u\n", r.trace, (unsigned)r.messages, (unsigned)r.bytes,
+               (unsigned)r.nsPerMessage, (unsigned)r.messagesPerSec, (unsigned)r.allocations);
+        if (check && r.allocations) {
+            fprintf(stderr, "bench_synergy: %s trace allocated %u times while decoding\n",
+                    r.trace, (unsigned)r.allocations);
+            status = 1;
+        }
+        if (maxNs && r.nsPerMessage > maxNs) {
+            fprintf(stderr, "bench_synergy: %s trace %u ns/msg exceeds %u\n",
+                    r.trace, (unsigned)r.nsPerMessage, (unsigned)maxNs);
+            status = 1;
+        }
+    }
+    return status;
+}
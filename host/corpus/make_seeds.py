@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Regenerate the fuzz_synergy seed corpus in corpus/synergy/.
+
+Each seed is one byte choosing how the stream is cut into socket reads
+(0 = whole windows, otherwise pseudo-random sizes) followed by what a server
+sends: its hello, then frames.
+"""
+
+import os
+import struct
+
+OUT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "synergy")
+
+
+def frame(body):
+    return struct.pack(">I", len(body)) + body
+
+
+def hello(proto=b"Synergy", major=1, minor=8):
+    return frame(proto + struct.pack(">HH", major, minor))
+
+
+def msg(cmd, fmt="", *args):
+    return frame(cmd + struct.pack(">" + fmt, *args))
+
+
+def string(data):
+    return struct.pack(">I", len(data)) + data
+
+
+def dclp(mark, data, clip_id=0, seq=1):
+    return frame(b"DCLP" + struct.pack(">BIB", clip_id, seq, mark) + string(data))
+
+
+def dsop(*pairs):
+    body = struct.pack(">I", len(pairs) * 2)
+    for opt, value in pairs:
+        body += opt + struct.pack(">i", value)
+    return frame(b"DSOP" + body)
+
+
+def clipboard(text):
+    # Serialized clipboard: count, then format/size/data per format
+    return struct.pack(">III", 1, 0, len(text)) + text
+
+
+def session_start():
+    return msg(b"QINF") + msg(b"CIAK") + msg(b"CALV") + msg(b"CINN", "hhIH", 100, 200, 1, 0)
+
+
+SEEDS = {
+    "handshake": (0, hello()),
+    "handshake_deskflow": (7, hello(b"Deskflow") + session_start()),
+    "handshake_barrier_old": (0, hello(b"Barrier", 1, 5) + session_start() + dclp(2, b"skipped")),
+    "handshake_bad_major": (0, hello(b"Synergy", 2, 0)),
+    "rejected_eunk": (0, hello() + msg(b"EUNK")),
+    "rejected_ebsy": (3, hello() + msg(b"EBSY")),
+    "options": (0, hello() + session_start()
+                + dsop((b"HART", 5000), (b"MDLT", 1), (b"CLPS", 1), (b"HDCL", 1), (b"SSVR", 0))
+                + msg(b"CALV") + msg(b"CROP") + dsop((b"HART", 0)) + dsop()),
+    "input": (0, hello() + session_start()
+              + msg(b"DMMV", "hh", 300, 400) + msg(b"DMDN", "B", 1) + msg(b"DMMV", "hh", 310, 410)
+              + msg(b"DMUP", "B", 1) + msg(b"DMWM", "hh", 0, -120)
+              + msg(b"DKDN", "HHH", 0x61, 0, 0x1E) + msg(b"DKRP", "HHHH", 0x61, 0, 2, 0x1E)
+              + msg(b"DKUP", "HHH", 0x61, 0, 0x1E) + msg(b"COUT")),
+    "relative_moves": (11, hello(minor=6) + session_start() + dsop((b"MDLT", 1))
+                       + b"".join(msg(b"DMRM", "hh", dx, -dx) for dx in range(-40, 40, 7))),
+    "clipboard_chunked": (0, hello() + session_start()
+                          + dclp(1, b"21") + dclp(2, clipboard(b"hello")[:9])
+                          + dclp(2, clipboard(b"hello")[9:]) + dclp(3, b"")),
+    "clipboard_oversized": (29, hello() + session_start()
+                            + dclp(1, b"3012") + dclp(2, clipboard(b"x" * 3000))
+                            + msg(b"DMMV", "hh", 1, 1) + dclp(3, b"")),
+    "clipboard_sharing_off": (0, hello() + session_start() + dsop((b"CLPS", 0))
+                              + dclp(1, b"17") + dclp(2, clipboard(b"a")) + dclp(3, b"")),
+    "secure_input_language": (5, hello(b"Deskflow") + session_start()
+                              + frame(b"SECN" + string(b"keepass")) + frame(b"LSYN" + string(b"ende"))),
+    "malformed_short": (0, hello() + session_start() + frame(b"DKDN\x00") + frame(b"DMMV")
+                        + frame(b"DCLP\x00") + frame(b"ZZZZ") + msg(b"DMMV", "hh", 5, 5)),
+    "ring_wrap": (13, hello() + session_start()
+                  + b"".join(msg(b"DMMV", "hh", i, i) for i in range(700))
+                  + b"".join(frame(b"CNOP" + bytes(900)) for _ in range(6))),
+    "bad_length": (0, hello() + session_start() + struct.pack(">I", 0x7FFFFFFF) + b"DMMV"),
+}
+
+
+def main():
+    os.makedirs(OUT, exist_ok=True)
+    for name, (chunking, stream) in SEEDS.items():
+        with open(os.path.join(OUT, name + ".bin"), "wb") as f:
+            f.write(bytes([chunking]) + stream)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,166 @@
+/**
+ * Stand-alone driver for fuzz_synergy when libFuzzer is not available (GCC)
+ *
+ *   fuzz_synergy [-runs=N] [-seed=S] <file-or-dir>...
+ *
+ * Replays every input given, then runs N mutated copies of them (bit flips,
+ * byte overwrites, inserts, deletes, splices and a new read-size byte). The
+ * sanitizers do the checking; an input that trips one aborts the run and is
+ * written to crash-<run>.bin so it can be replayed.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#if defined(__has_include)
+#if __has_include(<sanitizer/common_interface_defs.h>)
+#include <sanitizer/common_interface_defs.h>
+#define HAVE_DEATH_CALLBACK 1
+#endif
+#endif
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+typedef std::vector<uint8_t> Bytes;
+
+static bool readFile(const std::string& path, Bytes& out) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+static void collect(const std::string& path, std::vector<Bytes>& inputs) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        Bytes b;
+        if (readFile(path, b)) inputs.push_back(b);
+        else fprintf(stderr, "fuzz_synergy: can't read %s\n", path.c_str());
+        return;
+    }
+    std::vector<std::string> names;
+    while (dirent* e = readdir(dir)) {
+        if (e->d_name[0] != '.') names.push_back(e->d_name);
+    }
+    closedir(dir);
+    for (const std::string& name : names) collect(path + "/" + name, inputs);
+}
+
+static uint32_t _rng = 1;
+
+static uint32_t nextRandom() {
+    _rng ^= _rng << 13;
+    _rng ^= _rng >> 17;
+    _rng ^= _rng << 5;
+    return _rng;
+}
+
+static void mutate(Bytes& b, const std::vector<Bytes>& inputs) {
+    for (uint32_t edits = 1 + nextRandom() % 4; edits > 0; edits--) {
+        size_t at = b.empty() ? 0 : nextRandom() % b.size();
+        switch (nextRandom() % 7) {
+            case 0:  // Flip a bit
+                if (!b.empty()) b[at] ^= 1 << (nextRandom() % 8);
+                break;
+            case 1:  // Overwrite with an interesting byte
+                if (!b.empty()) {
+                    static const uint8_t VALUES[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF };
+                    b[at] = VALUES[nextRandom() % sizeof(VALUES)];
+                }
+                break;
+            case 2:  // Insert random bytes
+                for (uint32_t n = 1 + nextRandom() % 16; n > 0; n--) b.insert(b.begin() + at, (uint8_t)nextRandom());
+                break;
+            case 3:  // Delete a run
+                if (!b.empty()) b.erase(b.begin() + at, b.begin() + at + 1 + nextRandom() % (b.size() - at));
+                break;
+            case 4: {  // Splice in a slice of another input
+                const Bytes& other = inputs[nextRandom() % inputs.size()];
+                if (other.empty()) break;
+                size_t from = nextRandom() % other.size();
+                size_t len = 1 + nextRandom() % (other.size() - from);
+                b.insert(b.begin() + at, other.begin() + from, other.begin() + from + len);
+                break;
+            }
+            case 5:  // Big-endian length that may lie about the frame
+                if (b.size() >= at + 4) {
+                    uint32_t v = nextRandom() % 3 ? nextRandom() % 2048 : nextRandom();
+                    b[at] = v >> 24; b[at + 1] = v >> 16; b[at + 2] = v >> 8; b[at + 3] = v;
+                }
+                break;
+            default:  // Different read sizes for the same stream
+                if (!b.empty()) b[0] = (uint8_t)nextRandom();
+                break;
+        }
+    }
+}
+
+// Input being run, for the sanitizer death callback
+static const Bytes* _current = nullptr;
+static unsigned long _currentRun = 0;
+
+static void saveCrash() {
+    if (!_current) return;
+    char name[32];
+    snprintf(name, sizeof(name), "crash-%lu.bin", _currentRun);
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+    ssize_t written = write(fd, _current->data(), _current->size());
+    close(fd);
+    if (written >= 0) fprintf(stderr, "fuzz_synergy: input saved to %s\n", name);
+    _current = nullptr;
+}
+
+// UBSan (a separate runtime under GCC) skips the ASan death callback, so have
+// it abort instead and save the input from the signal handler
+extern "C" const char* __ubsan_default_options() {
+    return "abort_on_error=1:print_stacktrace=1";
+}
+
+static void onAbort(int) {
+    saveCrash();
+    signal(SIGABRT, SIG_DFL);
+    abort();
+}
+
+int main(int argc, char** argv) {
+    unsigned long runs = 0;
+    std::vector<Bytes> inputs;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) runs = strtoul(argv[i] + 6, nullptr, 10);
+        else if (strncmp(argv[i], "-seed=", 6) == 0) _rng = (uint32_t)strtoul(argv[i] + 6, nullptr, 10) | 1;
+        else collect(argv[i], inputs);
+    }
+    if (inputs.empty()) {
+        fprintf(stderr, "usage: %s [-runs=N] [-seed=S] <file-or-dir>...\n", argv[0]);
+        return 2;
+    }
+
+#ifdef HAVE_DEATH_CALLBACK
+    __sanitizer_set_death_callback(saveCrash);
+#endif
+    signal(SIGABRT, onAbort);
+
+    for (const Bytes& b : inputs) LLVMFuzzerTestOneInput(b.data(), b.size());
+    printf("fuzz_synergy: replayed %zu inputs\n", inputs.size());
+
+    for (unsigned long run = 0; run < runs; run++) {
+        Bytes b = inputs[nextRandom() % inputs.size()];
+        mutate(b, inputs);
+        _current = &b;
+        _currentRun = run;
+        LLVMFuzzerTestOneInput(b.data(), b.size());
+    }
+    _current = nullptr;
+    if (runs) printf("fuzz_synergy: %lu mutated runs clean\n", runs);
+    return 0;
+}
@@ -0,0 +1,58 @@
+/**
+ * Synergy decoder fuzz target
+ * Input layout: byte 0 picks how the stream is cut into socket reads
+ * (0 = whole 2 KB windows, otherwise pseudo-random 1..2048-byte reads), the
+ * rest is what the server sends, starting with its hello. Builds as a
+ * libFuzzer target with Clang, or with fuzz_main.cpp as a corpus replayer and
+ * mutator under any compiler.
+ */
+
+#include "../include/synergy_protocol.h"
+#include "replay_client.h"
+
+static volatile uint32_t _sink;
+
+// Callbacks touch everything they are handed so ASan sees bad pointers
+static void onMouse(int16_t x, int16_t y, int16_t wheelX, int16_t wheelY, bool l, bool m, bool r) {
+    _sink += x + y + wheelX + wheelY + l + m + r;
+}
+
+static void onRelativeMouse(int16_t dx, int16_t dy, bool l, bool m, bool r) {
+    _sink += dx + dy + l + m + r;
+}
+
+static void onKeyboard(uint16_t keyId, uint16_t modifiers, uint16_t button, bool down, bool repeat) {
+    _sink += keyId + modifiers + button + down + repeat;
+}
+
+static void onScreenActive(bool active) {
+    _sink += active;
+}
+
+static void onClipboard(uint8_t id, const uint8_t* data, size_t len, bool final) {
+    for (size_t i = 0; i < len; i++) _sink += data[i];
+    _sink += id + final;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size < 1) return 0;
+
+    ReplayClient client(data + 1, size - 1, data[0] ? data[0] * 0x9E3779B1u : 0);
+    static synergy::SynergyClient synergy;
+    synergy.resetState();
+    synergy.setMouseCallback(onMouse);
+    synergy.setRelativeMouseCallback(onRelativeMouse);
+    synergy.setKeyboardCallback(onKeyboard);
+    synergy.setScreenActiveCallback(onScreenActive);
+    synergy.setClipboardCallback(onClipboard);
+
+    // Every update() takes at least one read while the ring has room, and the
+    // ring never stays full (frames are at most a quarter of it), so this ends.
+    // false means the session was dropped (bad hello, corrupt length).
+    while (!client.done()) {
+        if (!synergy.update(client)) return 0;
+    }
+    synergy.update(client);  // Frames completed by the last read
+    synergy.takeDropReason();
+    return 0;
+}
@@ -0,0 +1,41 @@
+/**
+ * Minimal assertions for the host unit tests
+ * A failed check prints its location and values and the test keeps going;
+ * hostTestResult() turns the count into the exit status for ctest.
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+static int _hostTestFailures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            _hostTestFailures++;                                           \
+        }                                                                  \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                         \
+    do {                                                                   \
+        long long _a = (long long)(actual), _e = (long long)(expected);   \
+        if (_a != _e) {                                                    \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n",          \
+                    __FILE__, __LINE__, #actual, _a, _e);                  \
+            _hostTestFailures++;                                           \
+        }                                                                  \
+    } while (0)
+
+static inline int hostTestResult(const char* name) {
+    if (_hostTestFailures) {
+        fprintf(stderr, "%s: %d checks failed\n", name, _hostTestFailures);
+        return 1;
+    }
+    printf("%s: all checks passed\n", name);
+    return 0;
+}
+
+#endif // HOST_TEST_H
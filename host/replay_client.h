@@ -0,0 +1,58 @@
+/**
+ * In-memory Client for host builds
+ * Serves a byte buffer as if it were arriving on the W5500 socket and
+ * discards everything written. Reads are capped at a fixed window, or cut at
+ * pseudo-random sizes (1 byte up to the window) so frames straddle reads and
+ * update() calls the way they do on a real network.
+ */
+
+#ifndef REPLAY_CLIENT_H
+#define REPLAY_CLIENT_H
+
+#include <Client.h>
+
+class ReplayClient : public Client {
+public:
+    // W5500 default per-socket RX buffer
+    static const size_t SOCKET_WINDOW = 2048;
+
+    // chunkSeed 0 reads whole windows; anything else picks each read's size
+    ReplayClient(const uint8_t* data, size_t len, uint32_t chunkSeed = 0)
+        : _data(data), _len(len), _pos(0), _seed(chunkSeed), _rng(chunkSeed) {}
+
+    void rewind() { _pos = 0; _rng = _seed; }
+    bool done() const { return _pos >= _len; }
+
+    size_t write(uint8_t) override { return 1; }
+    size_t write(const uint8_t*, size_t size) override { return size; }
+    int available() override { return (int)(_len - _pos); }
+    int read() override { return done() ? -1 : _data[_pos++]; }
+    int read(uint8_t* buf, size_t size) override {
+        if (done()) return -1;
+        size_t n = _len - _pos;
+        if (n > size) n = size;
+        size_t window = _seed ? 1 + nextRandom() % SOCKET_WINDOW : SOCKET_WINDOW;
+        if (n > window) n = window;
+        memcpy(buf, _data + _pos, n);
+        _pos += n;
+        return (int)n;
+    }
+    uint8_t connected() override { return 1; }
+
+private:
+    // xorshift32: deterministic per input, so a crash replays exactly
+    uint32_t nextRandom() {
+        _rng ^= _rng << 13;
+        _rng ^= _rng >> 17;
+        _rng ^= _rng << 5;
+        return _rng;
+    }
+
+    const uint8_t* _data;
+    size_t _len;
+    size_t _pos;
+    uint32_t _seed;
+    uint32_t _rng;
+};
+
+#endif // REPLAY_CLIENT_H
@@ -0,0 +1,52 @@
+/**
+ * Host stand-in for the Arduino core
+ * Just enough of String, Serial and millis() to build the Synergy decoder on
+ * a PC. Serial output is discarded unless HOST_SERIAL is set in the environment.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+class String {
+public:
+    String() {}
+    String(const char* s) : _s(s ? s : "") {}
+    String(int v) : _s(std::to_string(v)) {}
+    String(unsigned v) : _s(std::to_string(v)) {}
+    String(long v) : _s(std::to_string(v)) {}
+    String(unsigned long v) : _s(std::to_string(v)) {}
+
+    unsigned length() const { return (unsigned)_s.size(); }
+    const char* c_str() const { return _s.c_str(); }
+
+    String& operator+=(const String& o) { _s += o._s; return *this; }
+    String& operator+=(const char* o) { _s += o; return *this; }
+    friend String operator+(String a, const String& b) { return a += b; }
+    friend String operator+(String a, const char* b) { return a += b; }
+    friend String operator+(const char* a, const String& b) { return String(a) += b; }
+
+private:
+    std::string _s;
+};
+
+class HostSerial {
+public:
+    void print(const String& s) { print(s.c_str()); }
+    void print(const char* s);
+    void println(const String& s) { println(s.c_str()); }
+    void println(const char* s = "");
+    int printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern HostSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+
+#endif // HOST_ARDUINO_H
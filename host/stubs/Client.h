@@ -0,0 +1,21 @@
+/**
+ * Host stand-in for the Arduino Client interface (the part SynergyClient uses)
+ */
+
+#ifndef HOST_CLIENT_H
+#define HOST_CLIENT_H
+
+#include "Arduino.h"
+
+class Client {
+public:
+    virtual ~Client() {}
+    virtual size_t write(uint8_t b) = 0;
+    virtual size_t write(const uint8_t* buf, size_t size) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int read(uint8_t* buf, size_t size) = 0;
+    virtual uint8_t connected() = 0;
+};
+
+#endif // HOST_CLIENT_H
@@ -0,0 +1,50 @@
+/**
+ * Host stand-in for the Arduino core — implementation
+ */
+
+#include "Arduino.h"
+#include "esp_timer.h"
+#include <chrono>
+#include <stdarg.h>
+#include <stdio.h>
+
+HostSerial Serial;
+
+static bool serialEnabled() {
+    static const bool enabled = getenv("HOST_SERIAL") != nullptr;
+    return enabled;
+}
+
+void HostSerial::print(const char* s) {
+    if (serialEnabled()) fputs(s, stderr);
+}
+
+void HostSerial::println(const char* s) {
+    if (serialEnabled()) fprintf(stderr, "%s\n", s);
+}
+
+int HostSerial::printf(const char* fmt, ...) {
+    if (!serialEnabled()) return 0;
+    va_list args;
+    va_start(args, fmt);
+    int n = vfprintf(stderr, fmt, args);
+    va_end(args);
+    return n;
+}
+
+static int64_t monotonicMicros() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+unsigned long millis() {
+    return (unsigned long)(monotonicMicros() / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)monotonicMicros();
+}
+
+int64_t esp_timer_get_time() {
+    return monotonicMicros();
+}
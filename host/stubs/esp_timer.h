@@ -0,0 +1,12 @@
+/**
+ * Host stand-in for esp_timer (latency::now())
+ */
+
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time();
+
+#endif // HOST_ESP_TIMER_H
@@ -0,0 +1,182 @@
+/**
+ * input_queue::SpscQueue overflow policy
+ * Fills the ring past the motion limit and into the reserve and checks what
+ * is queued, what is coalesced and what raises a release request.
+ */
+
+#include "../include/input_queue.h"
+#include "host_test.h"
+
+using namespace input_queue;
+
+static const uint32_t MOTION_LIMIT = INPUT_QUEUE_CAPACITY - INPUT_QUEUE_RESERVED;
+
+static Event move(int16_t dx, int16_t dy, int8_t wheel = 0, uint8_t buttons = 0) {
+    Event ev = {};
+    ev.type = EVENT_MOUSE;
+    ev.mouse.buttons = buttons;
+    ev.mouse.wheel = wheel;
+    ev.mouse.dx = dx;
+    ev.mouse.dy = dy;
+    return ev;
+}
+
+static Event key(uint8_t code, bool down) {
+    Event ev = {};
+    ev.type = EVENT_KEY;
+    ev.key.code = code;
+    ev.key.down = down;
+    return ev;
+}
+
+static Event releaseAll() {
+    Event ev = {};
+    ev.type = EVENT_RELEASE_ALL;
+    return ev;
+}
+
+// Motion stops at the motion limit and the rest is merged, nothing is lost
+static void motionCoalescesPastLimit() {
+    SpscQueue q;
+    for (uint32_t i = 0; i < MOTION_LIMIT + 12; i++) CHECK(q.push(move(1, -2, 1)));
+    CHECK_EQ(q.size(), MOTION_LIMIT);
+    CHECK_EQ(q.stats().pushed, MOTION_LIMIT + 12);
+    CHECK_EQ(q.stats().coalesced, 11u);  // The first overflow starts the pending move
+    CHECK_EQ(q.stats().overflows, 0u);
+    CHECK_EQ(q.stats().highWatermark, MOTION_LIMIT);
+    CHECK(!q.flushPending());  // Still no room below the limit
+
+    Event ev;
+    CHECK(q.pop(ev));
+    CHECK(q.flushPending());
+    CHECK_EQ(q.size(), MOTION_LIMIT);
+
+    int32_t dx = ev.mouse.dx, dy = ev.mouse.dy, wheel = ev.mouse.wheel;
+    Event last = ev;
+    while (q.pop(ev)) {
+        dx += ev.mouse.dx;
+        dy += ev.mouse.dy;
+        wheel += ev.mouse.wheel;
+        last = ev;
+    }
+    CHECK_EQ(last.mouse.dx, 12);
+    CHECK_EQ(last.mouse.dy, -24);
+    CHECK_EQ(dx, (int32_t)MOTION_LIMIT + 12);
+    CHECK_EQ(dy, -2 * ((int32_t)MOTION_LIMIT + 12));
+    CHECK_EQ(wheel, (int32_t)MOTION_LIMIT + 12);
+    CHECK(!q.takeReleaseRequest());
+}
+
+// A merged move saturates instead of wrapping
+static void coalescedMoveClamps() {
+    SpscQueue q;
+    for (uint32_t i = 0; i < MOTION_LIMIT; i++) q.push(move(0, 0));
+    for (int i = 0; i < 3; i++) q.push(move(30000, -30000, -100));
+    CHECK(q.push(key(0x04, true)));
+
+    Event ev;
+    for (uint32_t i = 0; i < MOTION_LIMIT; i++) q.pop(ev);
+    CHECK(q.pop(ev));
+    CHECK_EQ(ev.type, EVENT_MOUSE);
+    CHECK_EQ(ev.mouse.dx, INT16_MAX);
+    CHECK_EQ(ev.mouse.dy, INT16_MIN);
+    CHECK_EQ(ev.mouse.wheel, -127);
+}
+
+// Keys and button changes use the reserve, behind the pending move
+static void keysAndButtonsUseReserve() {
+    SpscQueue q;
+    for (uint32_t i = 0; i < MOTION_LIMIT + 3; i++) q.push(move(1, 1));
+    CHECK(q.push(key(0x04, true)));
+    CHECK(q.push(move(0, 0, 0, 0x01)));       // Left button down
+    CHECK(q.push(move(2, 2, 0, 0x01)));       // Motion while held: past the limit,
+    CHECK(q.push(move(3, 3, 0, 0x01)));       // so merged into one move
+    CHECK(q.push(key(0x04, false)));
+    CHECK_EQ(q.size(), MOTION_LIMIT + 5);
+    CHECK_EQ(q.stats().coalesced, 3u);
+    CHECK_EQ(q.stats().overflows, 0u);
+
+    Event ev;
+    for (uint32_t i = 0; i < MOTION_LIMIT; i++) q.pop(ev);
+    CHECK(q.pop(ev));
+    CHECK_EQ(ev.type, EVENT_MOUSE);
+    CHECK_EQ(ev.mouse.dx, 3);
+    CHECK(q.pop(ev));
+    CHECK_EQ(ev.type, EVENT_KEY);
+    CHECK(ev.key.down);
+    CHECK(q.pop(ev));
+    CHECK_EQ(ev.mouse.buttons, 0x01);
+    CHECK_EQ(ev.mouse.dx, 0);
+    CHECK(q.pop(ev));
+    CHECK_EQ(ev.mouse.buttons, 0x01);
+    CHECK_EQ(ev.mouse.dx, 5);
+    CHECK(q.pop(ev));
+    CHECK_EQ(ev.type, EVENT_KEY);
+    CHECK(!ev.key.down);
+    CHECK(!q.pop(ev));
+}
+
+// A release-all behind a motion-filled ring still gets a slot
+static void releaseAllFitsBehindMotion() {
+    SpscQueue q;
+    for (uint32_t i = 0; i < MOTION_LIMIT + 40; i++) q.push(move(1, 0));
+    CHECK(q.push(releaseAll()));
+    Event ev;
+    uint32_t n = 0;
+    while (q.pop(ev)) n++;
+    CHECK_EQ(n, MOTION_LIMIT + 2);
+    CHECK_EQ(ev.type, EVENT_RELEASE_ALL);
+    CHECK(!q.takeReleaseRequest());
+}
+
+// With the whole ring full, refused key-ups and release-alls become a
+// release request; motion is still only coalesced
+static void fullRingRaisesReleaseRequest() {
+    SpscQueue q;
+    for (uint32_t i = 0; i < INPUT_QUEUE_CAPACITY; i++) CHECK(q.push(key(0x04 + i % 8, i % 2 == 0)));
+    CHECK_EQ(q.size(), (uint32_t)INPUT_QUEUE_CAPACITY);
+    CHECK(!q.takeReleaseRequest());
+
+    CHECK(q.push(move(7, 7)));  // Coalesced, not refused
+    CHECK_EQ(q.stats().overflows, 0u);
+    CHECK(!q.push(key(0x04, false)));
+    CHECK(!q.push(releaseAll()));
+    CHECK(!q.push(move(0, 0, 0, 0x02)));
+    CHECK_EQ(q.stats().overflows, 3u);
+
+    CHECK(q.takeReleaseRequest());
+    CHECK(!q.takeReleaseRequest());  // Consumed once
+
+    // The pending move survives and goes out ahead of the next key
+    Event ev;
+    while (q.pop(ev)) {}
+    CHECK(q.push(key(0x05, true)));
+    CHECK(q.pop(ev));
+    CHECK_EQ(ev.type, EVENT_MOUSE);
+    CHECK_EQ(ev.mouse.dx, 7);
+    CHECK(q.pop(ev));
+    CHECK_EQ(ev.type, EVENT_KEY);
+}
+
+// The refused button change did not update the motion baseline
+static void refusedButtonKeepsBaseline() {
+    SpscQueue q;
+    for (uint32_t i = 0; i < INPUT_QUEUE_CAPACITY; i++) q.push(key(0x04, true));
+    CHECK(!q.push(move(0, 0, 0, 0x01)));
+    Event ev;
+    while (q.pop(ev)) {}
+    // Still buttons 0: plain motion, below the limit
+    CHECK(q.push(move(2, 2)));
+    CHECK_EQ(q.stats().overflows, 1u);
+    CHECK(q.takeReleaseRequest());
+}
+
+int main() {
+    motionCoalescesPastLimit();
+    coalescedMoveClamps();
+    keysAndButtonsUseReserve();
+    releaseAllFitsBehindMotion();
+    fullRingRaisesReleaseRequest();
+    refusedButtonKeepsBaseline();
+    return hostTestResult("test_input_queue");
+}
@@ -0,0 +1,279 @@
+/**
+ * KeyboardReport builder
+ * Drives press/release, layout strokes, modifier reconcile and rollover past
+ * six keys, checking the exact 8-byte boot report (or the N-key rollover
+ * bitmap) after each step and which steps leave nothing to send.
+ */
+
+#include "../include/keyboard_report.h"
+#include "../include/hid_keymap.h"
+#include "host_test.h"
+
+static void checkReport(const KeyboardReport& r, const uint8_t* expected, size_t size,
+                        const char* file, int line) {
+    if (r.size() == size && memcmp(r.bytes(), expected, size) == 0) return;
+    fprintf(stderr, "%s:%d: report is", file, line);
+    for (size_t i = 0; i < r.size(); i++) fprintf(stderr, " %02X", r.bytes()[i]);
+    fprintf(stderr, ", expected");
+    for (size_t i = 0; i < size; i++) fprintf(stderr, " %02X", expected[i]);
+    fprintf(stderr, "\n");
+    _hostTestFailures++;
+}
+
+#define CHECK_REPORT(r, ...)                                             \
+    do {                                                                 \
+        const uint8_t _expected[KEYBOARD_REPORT_SIZE] = { __VA_ARGS__ }; \
+        checkReport(r, _expected, sizeof(_expected), __FILE__, __LINE__); \
+    } while (0)
+
+// NKRO report: modifiers, then the bitmap bytes listed (the rest must be 0)
+#define CHECK_NKRO(r, ...)                                               \
+    do {                                                                 \
+        const uint8_t _expected[KEYBOARD_NKRO_SIZE] = { __VA_ARGS__ };   \
+        checkReport(r, _expected, sizeof(_expected), __FILE__, __LINE__); \
+    } while (0)
+
+static const uint8_t KEY_A = 0x04, KEY_B = 0x05, KEY_C = 0x06, KEY_2 = 0x1F;
+static const uint8_t LCTRL = 0xE0, LSHIFT = 0xE1, LALT = 0xE2, RSHIFT = 0xE5, RALT = 0xE6;
+
+// One report per change; a change that leaves the report alone sends nothing
+static void pressReleaseAndDedupe() {
+    KeyboardReport r;
+    CHECK(r.empty());
+    CHECK(!r.pending());
+
+    r.press(KEY_A);
+    CHECK_REPORT(r, 0x00, 0x00, KEY_A, 0, 0, 0, 0, 0);
+    CHECK(r.pending());
+    r.markSent();
+    CHECK(!r.pending());
+
+    r.press(KEY_A);  // Server repeat of a held key
+    CHECK(!r.pending());
+
+    r.press(LSHIFT);
+    CHECK_REPORT(r, 0x02, 0x00, KEY_A, 0, 0, 0, 0, 0);
+    r.press(KEY_B);
+    CHECK_REPORT(r, 0x02, 0x00, KEY_A, KEY_B, 0, 0, 0, 0);
+    r.release(KEY_A);
+    CHECK_REPORT(r, 0x02, 0x00, 0, KEY_B, 0, 0, 0, 0);
+    r.markSent();
+
+    r.release(KEY_C);  // Stray release: never pressed
+    r.release(0);
+    CHECK(!r.pending());
+
+    r.release(KEY_B);
+    r.release(LSHIFT);
+    CHECK_REPORT(r, 0, 0, 0, 0, 0, 0, 0, 0);
+    CHECK(r.empty());
+    CHECK(r.pending());
+}
+
+// A seventh key waits in the bitmap and takes the first slot that frees
+static void rolloverBackfill() {
+    KeyboardReport r;
+    for (uint8_t usage = 0x04; usage <= 0x0A; usage++) r.press(usage);
+    CHECK_REPORT(r, 0x00, 0x00, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09);
+    CHECK_EQ(r.rolloverOverflows(), 1u);
+    CHECK(r.isDown(0x0A));
+    r.markSent();
+
+    r.press(0x0B);
+    CHECK(!r.pending());  // Held back too: nothing to send
+    CHECK_EQ(r.rolloverOverflows(), 2u);
+
+    r.release(0x05);
+    CHECK_REPORT(r, 0x00, 0x00, 0x04, 0x0A, 0x06, 0x07, 0x08, 0x09);
+    r.markSent();
+
+    r.release(0x0B);  // Released while still held back: the host never saw it
+    CHECK(!r.isDown(0x0B));
+    CHECK(!r.pending());
+
+    r.release(0x04);
+    r.release(0x06);
+    CHECK_REPORT(r, 0x00, 0x00, 0, 0x0A, 0, 0x07, 0x08, 0x09);
+    CHECK_EQ(r.rolloverOverflows(), 2u);
+}
+
+// Layout strokes replace held Shift/AltGr (0x62) and leave Ctrl/Alt/GUI alone
+static void strokeReplacesShiftAndAltGr() {
+    KeyboardReport r;
+    r.press(LSHIFT);
+    r.pressStroke(KEY_2, 0x40);  // e.g. '@' as AltGr+Q-position key
+    CHECK_REPORT(r, 0x40, 0x00, KEY_2, 0, 0, 0, 0, 0);
+    r.releaseStroke(KEY_2);
+    CHECK_REPORT(r, 0x02, 0x00, 0, 0, 0, 0, 0, 0);
+
+    r.release(LSHIFT);
+    r.press(LCTRL);
+    r.press(RALT);
+    r.pressStroke(KEY_2, 0x02);
+    CHECK_REPORT(r, 0x03, 0x00, KEY_2, 0, 0, 0, 0, 0);
+
+    // A plain key press in between keeps the stroke's modifiers
+    r.press(KEY_A);
+    CHECK_REPORT(r, 0x03, 0x00, KEY_2, KEY_A, 0, 0, 0, 0);
+    r.releaseStroke(KEY_2);
+    CHECK_REPORT(r, 0x41, 0x00, 0, KEY_A, 0, 0, 0, 0);
+
+    // Releasing a different stroke key doesn't end the current one
+    r.pressStroke(KEY_B, 0x20);
+    r.releaseStroke(KEY_C);
+    CHECK_REPORT(r, 0x21, 0x00, KEY_B, KEY_A, 0, 0, 0, 0);
+}
+
+// Modifier classes are Ctrl 0x11, Shift 0x22, Alt 0x44, GUI 0x88: either side
+// satisfies the server, a missing class is pressed, an extra one released
+static void reconcileByClass() {
+    KeyboardReport r;
+    r.press(LSHIFT);
+    r.markSent();
+
+    CHECK(!r.reconcile(0x20));  // Server has Right Shift: same class
+    CHECK(!r.pending());
+
+    CHECK(r.reconcile(0x21));   // Ctrl missed its key-down
+    CHECK_REPORT(r, 0x03, 0x00, 0, 0, 0, 0, 0, 0);
+
+    CHECK(r.reconcile(0x01));   // Shift missed its key-up
+    CHECK_REPORT(r, 0x01, 0x00, 0, 0, 0, 0, 0, 0);
+
+    CHECK(!r.reconcile(0x11));  // Still Ctrl: Right Ctrl is not added
+    CHECK(!r.reconcile(0x10));
+    CHECK_REPORT(r, 0x01, 0x00, 0, 0, 0, 0, 0, 0);
+
+    r.press(LALT);
+    CHECK(!r.reconcile(0x41));  // AltGr reported for Left Alt: same class
+    CHECK(r.reconcile(0x88));   // Everything else up, GUI (both sides) down
+    CHECK_REPORT(r, 0x88, 0x00, 0, 0, 0, 0, 0, 0);
+
+    // Keys are untouched by reconcile
+    r.press(KEY_A);
+    CHECK(r.reconcile(0x00));
+    CHECK_REPORT(r, 0x00, 0x00, KEY_A, 0, 0, 0, 0, 0);
+}
+
+// Reconcile works on held modifiers; a stroke's replacement stays on top
+static void reconcileUnderStroke() {
+    KeyboardReport r;
+    r.pressStroke(KEY_2, 0x02);
+    CHECK(r.reconcile(0x22));   // Server's Shift is the stroke's own
+    CHECK_REPORT(r, 0x02, 0x00, KEY_2, 0, 0, 0, 0, 0);
+    r.releaseStroke(KEY_2);
+    CHECK_REPORT(r, 0x22, 0x00, 0, 0, 0, 0, 0, 0);
+}
+
+static void clearAndResync() {
+    KeyboardReport r;
+    r.press(LCTRL);
+    r.press(RSHIFT);
+    r.pressStroke(KEY_A, 0x40);
+    r.markSent();
+    r.clear();
+    CHECK(r.empty());
+    CHECK(!r.isDown(KEY_A));
+    CHECK_REPORT(r, 0, 0, 0, 0, 0, 0, 0, 0);
+    CHECK(r.pending());
+    r.markSent();
+    CHECK(!r.pending());
+
+    // Host state unknown: the blank report goes out again
+    r.resync();
+    CHECK(r.pending());
+    r.markSent();
+
+    // The stroke ended with clear(): a later Shift is not replaced
+    r.press(LSHIFT);
+    CHECK_REPORT(r, 0x02, 0x00, 0, 0, 0, 0, 0, 0);
+}
+
+// The keymap feeds the builder: Synergy buttons to usages and modifier bits
+static void keymapIntoReport() {
+    CHECK_EQ(hid_keymap::usageFor(0x1E), KEY_A);
+    CHECK_EQ(hid_keymap::usageFor(0x2A), LSHIFT);
+    CHECK_EQ(hid_keymap::usageFor(0xE038), RALT);
+    CHECK_EQ(hid_keymap::usageFor(0x0138), RALT);
+    CHECK_EQ(hid_keymap::modifierBit(RALT), 0x40);
+    CHECK_EQ(hid_keymap::modifierBit(KEY_A), 0);
+
+    KeyboardReport r;
+    r.press(hid_keymap::usageFor(0x0138));
+    r.press(hid_keymap::usageFor(0x10));  // Q
+    CHECK_REPORT(r, 0x40, 0x00, 0x14, 0, 0, 0, 0, 0);
+}
+
+// Every key down has its bit; nothing is held back past six keys
+static void nkroBitmap() {
+    KeyboardReport r;
+    r.setFormat(KeyboardReport::FORMAT_NKRO);
+    CHECK_EQ(r.size(), (size_t)KEYBOARD_NKRO_SIZE);
+    CHECK(r.pending());  // Format change resends
+    r.markSent();
+    CHECK(!r.pending());
+
+    r.press(LSHIFT);
+    r.press(KEY_A);  // Usage 0x04: bitmap byte 0, bit 4
+    CHECK_NKRO(r, 0x02, 0x10);
+    for (uint8_t usage = 0x05; usage <= 0x0B; usage++) r.press(usage);
+    CHECK_NKRO(r, 0x02, 0xF0, 0x0F);
+    CHECK_EQ(r.rolloverOverflows(), 0u);
+    r.markSent();
+
+    r.press(0x8B);  // Highest usage the keymap produces: last bitmap byte
+    CHECK_NKRO(r, 0x02, 0xF0, 0x0F, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x08);
+    r.press(0x8B);
+    r.markSent();
+    r.press(0x8B);   // Already down
+    CHECK(!r.pending());
+
+    r.pressStroke(KEY_2, 0x40);  // Stroke replaces Shift in the NKRO report too
+    CHECK_NKRO(r, 0x40, 0xF0, 0x0F, 0x00, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x08);
+    r.releaseStroke(KEY_2);
+    r.release(0x8B);
+    r.release(KEY_A);
+    CHECK_NKRO(r, 0x02, 0xE0, 0x0F);
+
+    r.clear();
+    CHECK_NKRO(r, 0x00);
+    CHECK(r.empty());
+}
+
+// Switching format keeps what is down and resends it in the new layout
+static void formatSwitchKeepsKeys() {
+    KeyboardReport r;
+    r.setFormat(KeyboardReport::FORMAT_NKRO);
+    for (uint8_t usage = 0x04; usage <= 0x0A; usage++) r.press(usage);
+    r.press(LCTRL);
+    r.markSent();
+
+    // Host went to boot protocol: six keys, the seventh waits for a slot
+    r.setFormat(KeyboardReport::FORMAT_BOOT);
+    CHECK(r.pending());
+    CHECK_REPORT(r, 0x01, 0x00, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09);
+    r.markSent();
+    r.release(0x04);
+    CHECK_REPORT(r, 0x01, 0x00, 0x0A, 0x05, 0x06, 0x07, 0x08, 0x09);
+    r.markSent();
+
+    r.setFormat(KeyboardReport::FORMAT_BOOT);  // No change: nothing to resend
+    CHECK(!r.pending());
+
+    r.setFormat(KeyboardReport::FORMAT_NKRO);
+    CHECK(r.pending());
+    CHECK_NKRO(r, 0x01, 0xE0, 0x07);
+}
+
+int main() {
+    pressReleaseAndDedupe();
+    rolloverBackfill();
+    strokeReplacesShiftAndAltGr();
+    reconcileByClass();
+    reconcileUnderStroke();
+    clearAndResync();
+    keymapIntoReport();
+    nkroBitmap();
+    formatSwitchKeepsKeys();
+    return hostTestResult("test_keyboard_report");
+}
@@ -13,14 +13,45 @@ namespace ble_hid {
 /** Initialize BLE stack and HID (keyboard + mouse). Name from device_name module. */
 void begin(const char* deviceName);
 
-/** Send keyboard report (modifiers + key codes). */
-void keyboardReport(uint8_t modifiers, const uint8_t* keys);
+struct KeyboardStats {
+    uint32_t reports;     // Keyboard notifications sent
+    uint32_t suppressed;  // Key events that left the report unchanged (nothing sent)
+    uint32_t rolloverOverflows;  // Presses held back because six keys were already down (boot report)
+    uint32_t forcedReleases;     // Release-alls or disconnects that found keys/buttons still down
+    uint32_t modifierFixes;      // Key events whose server modifier state corrected ours
+    bool nkro;                   // Sending the N-key rollover report (else the six-key boot report)
+};
 
-/** Press or release a single key (ASCII or special key code). */
-void keyPress(uint8_t asciiKey, uint16_t modifiers, bool down);
+/**
+ * Press or release a single key by HID usage (0xE0-0xE7 are modifiers).
+ * serverMods is the server's modifier state as HID bits; for non-modifier keys
+ * the held modifiers are reconciled against it in the same report.
+ * Returns true if a report was handed to the BLE stack (not when no host is
+ * connected or the report was unchanged).
+ */
+bool keyPress(uint8_t usage, uint8_t serverMods, bool down);
+
+/**
+ * Press or release a key translated through the target keyboard layout.
+ * While it is down, strokeMods (HID Shift/AltGr bits) replace the held Shift
+ * and AltGr so the character comes out as intended. Returns as keyPress().
+ */
+bool strokePress(uint8_t usage, uint8_t strokeMods, uint8_t serverMods, bool down);
 
-/** Send mouse report (buttons, dx, dy, wheel). */
-void mouseReport(uint8_t buttons, int8_t dx, int8_t dy, int8_t wheel);
+/**
+ * Release every key and mouse button (screen leave, lost session). Works while
+ * the host is away too, so nothing is still held when it comes back.
+ */
+void releaseAll();
+
+/** Keyboard report counters. */
+const KeyboardStats& keyboardStats();
+
+/**
+ * Send mouse report (buttons, dx, dy, wheel). Returns true if a report was
+ * handed to the BLE stack; motion within the rate limit is only accumulated.
+ */
+bool mouseReport(uint8_t buttons, int8_t dx, int8_t dy, int8_t wheel);
 
 /** Whether a HID host is connected. */
 bool isConnected();
@@ -18,12 +18,41 @@
 
 // ——— Deskflow/Synergy ———
 #define DESKFLOW_TCP_PORT    24800  // Default Synergy/Deskflow port
+// Failover between configured servers: per-server exponential backoff (with
+// jitter) from BASE to MAX after each failed connect or lost session
+#define DESKFLOW_MAX_ENDPOINTS        4
+#define DESKFLOW_RETRY_BASE_MS        1000
+#define DESKFLOW_RETRY_MAX_MS         30000
+#define DESKFLOW_HANDSHAKE_TIMEOUT_MS 5000  // TCP up but no server hello
+// Server hostnames are resolved without blocking and the address is reused
+// for its DNS TTL (clamped to this range); on DNS failure the last address is used
+#define DESKFLOW_DNS_TIMEOUT_MS       3000
+#define DESKFLOW_DNS_MIN_TTL_S        30
+#define DESKFLOW_DNS_MAX_TTL_S        3600
+// Virtual screen reported to the server until changed from the WebUI (kept in NVS)
+#define SCREEN_DEFAULT_WIDTH   1920
+#define SCREEN_DEFAULT_HEIGHT  1080
 
 // ——— Web dashboard ———
 #define WEBUI_HTTP_PORT      80
 
 // ——— BLE HID ———
 #define BLE_DEVICE_NAME_PREFIX  "Deskflow-"
+// Keyboard report in report protocol: 1 sends the N-key rollover bitmap, so
+// no key is held back however many are down; 0 sends the six-key boot layout.
+// A host that switches to boot protocol (BIOS, boot loaders) always gets six keys.
+#define BLE_HID_NKRO            1
+
+// ——— Input pipeline ———
+// Synergy decoding runs in loop() (core 1); BLE HID output drains the input
+// queue from its own task. NimBLE's host task lives on core 0.
+#define HID_TASK_ENABLED     1
+#define HID_TASK_CORE        0
+#define HID_TASK_STACK       4096
+#define HID_TASK_PRIORITY    2
+// Key repeat (DKRP) while a key is held: 0 drops it and lets the target's own
+// autorepeat run; 1 forwards each one as a release + press
+#define KEY_REPEAT_PASSTHROUGH  0
 
 // ——— Ethernet fallback when DHCP fails (e.g. cable unplugged at boot) ———
 #define ETHERNET_FALLBACK_IP     192, 168, 1, 177
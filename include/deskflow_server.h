@@ -7,6 +7,9 @@
 #define DESKFLOW_SERVER_H
 
 #include <Arduino.h>
+#include "synergy_protocol.h"
+#include "input_queue.h"
+#include "keyboard_layout.h"
 
 namespace deskflow {
 
@@ -16,9 +19,52 @@ void begin();
 /** Process incoming clients and parse events. Call from loop. */
 void poll();
 
-/** Configure remote Deskflow endpoint (e.g. tcp://host:port). Empty to use local TCP server only. */
+/** Forward queued input events to BLE HID (consumer side of the input queue). */
+void drainInput();
+
+/**
+ * Configure remote Deskflow endpoints: one or more tcp://host:port, comma-separated,
+ * in priority order (up to DESKFLOW_MAX_ENDPOINTS). Empty to disconnect.
+ */
 void setRemoteEndpoint(const String& url);
 
+/** Endpoints with their state, e.g. "a:24800 (connected), b:24800 (2 failures, retry in 4 s)". */
+String endpointSummary();
+
+/** Screen geometry reported to the server (persisted across reboots). */
+synergy::ScreenGeometry screenGeometry();
+
+/** Change, persist and re-announce the screen geometry. Returns false if width/height are zero or too large. */
+bool setScreenGeometry(const synergy::ScreenGeometry& geometry);
+
+/** Layout of the target computer's keyboard (persisted across reboots). */
+keyboard_layout::Layout keyboardLayout();
+
+/** Change and persist the target keyboard layout. */
+void setKeyboardLayout(keyboard_layout::Layout layout);
+
+/** Negotiated protocol and features, e.g. "Deskflow 1.8 (relative moves, ...)", or "not connected". */
+String sessionSummary();
+
+/** Synergy receive path counters (socket reads, bytes, messages). */
+const synergy::Stats& protocolStats();
+
+/** Plain-text table of per-command counts, bytes, age and handler time (commands seen so far). */
+String messageReport();
+
+struct KeyStats {
+    uint32_t repeatsDropped;    // DKRP not forwarded because the key was held (target autorepeats)
+    uint32_t repeatsForwarded;  // DKRP sent on as release + press (KEY_REPEAT_PASSTHROUGH)
+    uint32_t longestHoldMs;     // Longest a key has been held
+    uint32_t strayReleases;     // DKUP for a key that wasn't down
+};
+
+/** Key repeat and hold counters. */
+const KeyStats& keyStats();
+
+/** Input queue depth and overflow counters. */
+const input_queue::Stats& inputQueueStats();
+
 } // namespace deskflow
 
 #endif // DESKFLOW_SERVER_H
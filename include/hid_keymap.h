@@ -0,0 +1,83 @@
+/**
+ * Synergy key button to USB HID usage translation
+ * Flash-resident tables built at compile time, so a keystroke is one lookup
+ * from the DKDN/DKUP button field straight to a HID Keyboard page usage.
+ */
+
+#ifndef HID_KEYMAP_H
+#define HID_KEYMAP_H
+
+#include <Arduino.h>
+
+namespace hid_keymap {
+
+// Modifier usages (Left Ctrl .. Right GUI) occupy the report's modifier byte
+#define HID_USAGE_FIRST_MODIFIER 0xE0
+#define HID_USAGE_LAST_MODIFIER  0xE7
+
+// IBM PC AT scancode set 1, as sent in the button field by Deskflow/Barrier
+static constexpr uint8_t SCANCODE_USAGE[128] = {
+    0x00, 0x29, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23,  // 00-07: ?, Esc, 1-6
+    0x24, 0x25, 0x26, 0x27, 0x2D, 0x2E, 0x2A, 0x2B,  // 08-0F: 7-0, -, =, Backspace, Tab
+    0x14, 0x1A, 0x08, 0x15, 0x17, 0x1C, 0x18, 0x0C,  // 10-17: Q-I
+    0x12, 0x13, 0x2F, 0x30, 0x28, 0xE0, 0x04, 0x16,  // 18-1F: O, P, [, ], Enter, LCtrl, A, S
+    0x07, 0x09, 0x0A, 0x0B, 0x0D, 0x0E, 0x0F, 0x33,  // 20-27: D-L, ;
+    0x34, 0x35, 0xE1, 0x31, 0x1D, 0x1B, 0x06, 0x19,  // 28-2F: ', `, LShift, \, Z-V
+    0x05, 0x11, 0x10, 0x36, 0x37, 0x38, 0xE5, 0x55,  // 30-37: B-M, ,, ., /, RShift, KP*
+    0xE2, 0x2C, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E,  // 38-3F: LAlt, Space, CapsLock, F1-F5
+    0x3F, 0x40, 0x41, 0x42, 0x43, 0x53, 0x47, 0x5F,  // 40-47: F6-F10, NumLock, ScrollLock, KP7
+    0x60, 0x61, 0x56, 0x5C, 0x5D, 0x5E, 0x57, 0x59,  // 48-4F: KP8, KP9, KP-, KP4, KP5, KP6, KP+, KP1
+    0x5A, 0x5B, 0x62, 0x63, 0x46, 0x00, 0x64, 0x44,  // 50-57: KP2, KP3, KP0, KP., SysRq, ?, NonUS\, F11
+    0x45, 0x67, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 58-5F: F12, KP=
+    0x00, 0x00, 0x00, 0x00, 0x68, 0x69, 0x6A, 0x6B,  // 60-67: F13-F16
+    0x6C, 0x6D, 0x6E, 0x6F, 0x70, 0x71, 0x72, 0x00,  // 68-6F: F17-F23
+    0x88, 0x00, 0x00, 0x87, 0x00, 0x00, 0x73, 0x00,  // 70-77: Kana, Ro, F24
+    0x00, 0x8A, 0x00, 0x8B, 0x00, 0x89, 0x85, 0x00,  // 78-7F: Henkan, Muhenkan, Yen, KP,
+};
+
+// E0-prefixed scancodes, sent as 0x01xx (Barrier) or 0xE0xx
+static constexpr uint8_t EXTENDED_USAGE[128] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 00-07
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 08-0F
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 10-17
+    0x00, 0x00, 0x00, 0x00, 0x58, 0xE4, 0x00, 0x00,  // 18-1F: KP Enter, RCtrl
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 20-27
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 28-2F
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x54, 0x00, 0x46,  // 30-37: KP/, PrintScreen
+    0xE6, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 38-3F: RAlt
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x53, 0x48, 0x4A,  // 40-47: NumLock, Pause, Home
+    0x52, 0x4B, 0x00, 0x50, 0x00, 0x4F, 0x00, 0x4D,  // 48-4F: Up, PgUp, Left, Right, End
+    0x51, 0x4E, 0x49, 0x4C, 0x00, 0x00, 0x00, 0x00,  // 50-57: Down, PgDn, Insert, Delete
+    0x00, 0x00, 0x00, 0xE3, 0xE7, 0x65, 0x00, 0x00,  // 58-5F: LGUI, RGUI, Menu
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 60-67
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 68-6F
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 70-77
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // 78-7F
+};
+
+/** Usage for a scancode button, or 0 if it isn't one we know. */
+constexpr uint8_t usageForScancode(uint16_t button) {
+    return button < 0x80 ? SCANCODE_USAGE[button]
+         : (((button & 0xFF00) == 0x0100 || (button & 0xFF00) == 0xE000) && (button & 0x80) == 0)
+           ? EXTENDED_USAGE[button & 0x7F]
+         : 0;
+}
+
+constexpr bool isModifier(uint8_t usage) {
+    return usage >= HID_USAGE_FIRST_MODIFIER && usage <= HID_USAGE_LAST_MODIFIER;
+}
+
+/** Bit in the report's modifier byte for a modifier usage (0 for other keys). */
+constexpr uint8_t modifierBit(uint8_t usage) {
+    return isModifier(usage) ? (uint8_t)(1 << (usage - HID_USAGE_FIRST_MODIFIER)) : 0;
+}
+
+/**
+ * HID usage for a DKDN/DKUP/DKRP button: scancodes first, then X11 keysyms
+ * for servers that put those in the button field. 0 if unmapped.
+ */
+uint8_t usageFor(uint16_t button);
+
+} // namespace hid_keymap
+
+#endif // HID_KEYMAP_H
@@ -0,0 +1,98 @@
+/**
+ * Input event queue between the Synergy decoder and BLE HID output
+ * Fixed-capacity single-producer/single-consumer ring, no heap, no locks.
+ */
+
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+namespace input_queue {
+
+// Capacity must be a power of two
+#define INPUT_QUEUE_CAPACITY 64
+// Slots only keys, button changes and release-alls may take: motion stops
+// short of them and coalesces instead
+#define INPUT_QUEUE_RESERVED 16
+
+enum EventType : uint8_t {
+    EVENT_MOUSE,        // Button state plus relative motion/wheel
+    EVENT_KEY,          // Single key press or release
+    EVENT_RELEASE_ALL,  // Blank keyboard and mouse reports (screen leave)
+};
+
+// Compact tagged union (12 bytes)
+struct Event {
+    uint8_t type;
+    union {
+        struct {
+            uint8_t buttons;
+            int8_t wheel;
+            int16_t dx;
+            int16_t dy;
+        } mouse;
+        struct {
+            uint8_t code;        // HID keyboard usage (see hid_keymap)
+            bool down;
+            uint16_t modifiers;  // Synergy modifier mask
+            bool stroke;         // Translated through the target layout (see ble_hid::strokePress)
+            uint8_t strokeMods;  // HID Shift/AltGr bits the stroke needs
+        } key;
+    };
+    uint32_t rxMicros;  // When the source frame left the socket (latency::now())
+};
+
+struct Stats {
+    uint32_t pushed;        // Events accepted (including coalesced moves)
+    uint32_t coalesced;     // Mouse moves merged into a pending move while full
+    uint32_t overflows;     // Key/button events that found even the reserve full
+    uint32_t highWatermark; // Maximum observed depth
+};
+
+/**
+ * Overflow policy: motion (a mouse event whose buttons match the previous one)
+ * may fill the ring only up to INPUT_QUEUE_RESERVED slots short of capacity.
+ * Past that it is merged into a producer-side pending move (deltas and wheel
+ * are summed) and enqueued as one event once a slot frees up, so motion is
+ * never lost, only batched. Keys, button changes and release-alls may use the
+ * reserve; the pending move is enqueued ahead of them so clicks and motion
+ * stay in order. If one of those finds the whole ring full, push() returns
+ * false and raises a release request: the consumer sees it through
+ * takeReleaseRequest() once it has drained the ring and releases everything,
+ * so a lost key-up or release-all never leaves anything stuck.
+ */
+class SpscQueue {
+public:
+    SpscQueue();
+
+    // Producer side
+    bool push(const Event& ev);
+    bool flushPending();  // Try to enqueue a merged move; call once per producer pass
+
+    // Consumer side
+    bool pop(Event& ev);
+    bool takeReleaseRequest();  // True once after a key/button/release-all was refused
+
+    uint32_t size() const;
+    const Stats& stats() const { return _stats; }
+
+private:
+    bool tryPush(const Event& ev, uint32_t limit);
+
+    Event _slots[INPUT_QUEUE_CAPACITY];
+    std::atomic<uint32_t> _head; // Next slot to write (producer-owned)
+    std::atomic<uint32_t> _tail; // Next slot to read (consumer-owned)
+    std::atomic<bool> _releaseRequest; // Set by the producer, cleared by the consumer
+
+    // Producer-owned overflow state
+    Event _pending;
+    bool _hasPending;
+    uint8_t _lastButtons;  // Buttons of the last mouse event accepted
+    Stats _stats;
+};
+
+} // namespace input_queue
+
+#endif // INPUT_QUEUE_H
@@ -0,0 +1,52 @@
+/**
+ * Target keyboard layouts
+ * Maps the character a Synergy key event stands for (its key id) to the key
+ * and modifiers that type that character under the target computer's layout.
+ */
+
+#ifndef KEYBOARD_LAYOUT_H
+#define KEYBOARD_LAYOUT_H
+
+#include <Arduino.h>
+
+namespace keyboard_layout {
+
+enum Layout : uint8_t {
+    LAYOUT_SCANCODE,  // Positional: forward the server's scancodes untouched
+    LAYOUT_US,
+    LAYOUT_UK,
+    LAYOUT_DE,
+    LAYOUT_FR,
+    LAYOUT_NORDIC,    // Swedish / Finnish
+    LAYOUT_COUNT
+};
+
+// Stroke flags
+#define STROKE_SHIFT 0x01  // Hold Shift
+#define STROKE_ALTGR 0x02  // Hold AltGr (Right Alt)
+#define STROKE_DEAD  0x04  // Dead key: follow with Space to get the character itself
+
+struct Stroke {
+    uint8_t usage;  // HID keyboard usage (position named after the US legend)
+    uint8_t flags;
+};
+
+/** Short name used in settings and the web UI ("scancode", "us", "de", ...). */
+const char* name(Layout layout);
+
+/** Layout for a short name; false if unknown. */
+bool fromName(const String& name, Layout& out);
+
+/**
+ * Stroke that types a Synergy key id (a Unicode code point for printable keys)
+ * under the given layout. False for non-character keys, characters the layout
+ * can't type directly and LAYOUT_SCANCODE; callers then use the scancode.
+ */
+bool lookup(Layout layout, uint16_t keyId, Stroke& out);
+
+/** HID modifier byte bits (Left Shift, Right Alt) for a stroke's flags. */
+uint8_t hidModifiers(uint8_t flags);
+
+} // namespace keyboard_layout
+
+#endif // KEYBOARD_LAYOUT_H
@@ -0,0 +1,99 @@
+/**
+ * HID keyboard report builder
+ * Keeps the keyboard report and edits it in place, so each logical key change
+ * costs one notification and a change that leaves the report as it was costs
+ * none. Every key that is down is tracked in a bitmap of usages, which is
+ * sent in one of two formats:
+ *   FORMAT_BOOT  8-byte boot report (modifier byte, reserved, six key slots).
+ *                A seventh key is not lost: it takes the first slot another
+ *                key frees.
+ *   FORMAT_NKRO  Modifier byte plus one bit per usage 0x00-0x8F (N-key
+ *                rollover); every key the firmware can produce has a bit.
+ */
+
+#ifndef KEYBOARD_REPORT_H
+#define KEYBOARD_REPORT_H
+
+#include <Arduino.h>
+
+#define KEYBOARD_REPORT_SIZE 8
+#define KEYBOARD_REPORT_KEYS 6
+// N-key rollover report: modifiers + bitmap, 19 bytes so it fits one
+// notification at the default ATT MTU
+#define KEYBOARD_NKRO_USAGES 0x90
+#define KEYBOARD_NKRO_SIZE   (1 + KEYBOARD_NKRO_USAGES / 8)
+
+class KeyboardReport {
+public:
+    enum Format : uint8_t {
+        FORMAT_BOOT,
+        FORMAT_NKRO,
+    };
+
+    KeyboardReport();
+
+    /** Switch the report sent to the host; the next one is sent even if unchanged. */
+    void setFormat(Format format);
+    Format format() const { return _format; }
+
+    /** Press/release by HID usage; 0xE0-0xE7 set the modifier byte, others a key slot. */
+    void press(uint8_t usage);
+    void release(uint8_t usage);
+
+    /**
+     * Press/release a key typed through the target layout. While it is down,
+     * strokeMods (Shift/AltGr bits) replace the held Shift and AltGr.
+     */
+    void pressStroke(uint8_t usage, uint8_t strokeMods);
+    void releaseStroke(uint8_t usage);
+
+    /**
+     * Bring the held modifiers in line with the modifier state the server
+     * reports (HID bits, one side per modifier is enough). A modifier the
+     * server has down but we don't gets pressed; one we hold that the server
+     * doesn't is released. Returns true if anything changed.
+     */
+    bool reconcile(uint8_t serverMods);
+
+    /** Release everything. */
+    void clear();
+
+    /** The report differs from the last one marked sent. */
+    bool pending() const;
+
+    /** Current report in the active format, and its length. */
+    const uint8_t* bytes() const { return _format == FORMAT_NKRO ? _nkro : _report; }
+    size_t size() const { return _format == FORMAT_NKRO ? KEYBOARD_NKRO_SIZE : KEYBOARD_REPORT_SIZE; }
+
+    /** Record the current report as delivered to the host. */
+    void markSent();
+
+    /** Host state unknown (e.g. after a reconnect): the next report is sent even if unchanged. */
+    void resync();
+
+    /** No keys or modifiers down. */
+    bool empty() const;
+
+    /** Whether a non-modifier usage is down (in a slot or waiting for one). */
+    bool isDown(uint8_t usage) const { return _down[usage >> 3] & (1 << (usage & 7)); }
+
+    /** Boot format presses that found all six slots taken (held back until one frees). */
+    uint32_t rolloverOverflows() const { return _overflows; }
+
+private:
+    void setKey(uint8_t usage, bool down);
+    void backfill();
+    void updateModifiers();
+
+    uint8_t _report[KEYBOARD_REPORT_SIZE];
+    uint8_t _nkro[KEYBOARD_NKRO_SIZE];  // Modifiers, then _down's first bytes
+    uint8_t _sent[KEYBOARD_NKRO_SIZE];  // Last report sent, in the active format
+    Format _format;
+    uint8_t _down[32];     // Every non-modifier usage that is down
+    uint8_t _heldMods;     // Modifier keys the server has down
+    uint8_t _strokeUsage;  // Layout-translated key currently down, if any
+    uint8_t _strokeMods;
+    uint32_t _overflows;
+};
+
+#endif // KEYBOARD_REPORT_H
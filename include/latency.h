@@ -0,0 +1,50 @@
+/**
+ * Input latency instrumentation
+ * Per-stage histograms of the time from draining a Synergy frame out of the
+ * W5500 socket to each later point in the pipeline (esp_timer microseconds).
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+namespace latency {
+
+// Each stage is measured from the socket drain that delivered the frame
+enum Stage : uint8_t {
+    STAGE_DECODE,    // Frame handler started
+    STAGE_DISPATCH,  // Input callback queued the event
+    STAGE_BLE,       // HID report handed to the BLE stack
+    STAGE_COUNT
+};
+
+struct Summary {
+    uint32_t count;
+    uint32_t p50;  // Upper bound of the bucket holding the percentile (us)
+    uint32_t p99;
+    uint32_t max;  // Exact (us)
+};
+
+/** Microsecond timestamp for trace points (wraps after ~71 minutes; use differences). */
+inline uint32_t now() { return (uint32_t)esp_timer_get_time(); }
+
+/** Add one sample. Each stage must only be recorded from one task. */
+void record(Stage stage, uint32_t micros);
+
+/** Percentiles for one stage. */
+Summary summary(Stage stage);
+
+/** Plain-text table of all stages (for serial and HTTP). */
+String report();
+
+/**
+ * Clear all histograms. Safe from any task: each stage is cleared by its own
+ * writer at its next record(), and reads as empty until then.
+ */
+void reset();
+
+} // namespace latency
+
+#endif // LATENCY_H
@@ -11,44 +11,277 @@
 
 namespace synergy {
 
-// Protocol version
+// Protocol version: we speak up to 1.8 (language sync) and answer the server's
+// hello with the highest minor version both sides know. Older servers are
+// accepted; below MINOR_MIN (chunked clipboard) their clipboard is skipped.
 #define SYNERGY_PROTOCOL_MAJOR 1
-#define SYNERGY_PROTOCOL_MINOR 6
+#define SYNERGY_PROTOCOL_MINOR 8
+#define SYNERGY_PROTOCOL_MINOR_MIN 6
+
+// Keep-alive: the server sends CALV every period; if nothing at all arrives for
+// period * multiple the connection is considered dead (matches Synergy's 3 x 3 s)
+#define SYNERGY_KEEPALIVE_PERIOD_MS 3000
+#define SYNERGY_KEEPALIVE_MULTIPLE 3
 
 // Buffer sizes
+// Receive buffer is a ring; size must be a power of two so indices can be masked.
 #define SYNERGY_RECV_BUFFER_SIZE 4096
+// Largest frame handled in place; bigger frames (e.g. DCLP clipboard) are skipped.
+// Frames that wrap around the end of the ring are linearized into a buffer of this size.
+#define SYNERGY_MAX_FRAME_SIZE 1024
+// Replies are staged and flushed in one write per update(); a single reply
+// must fit in SYNERGY_MAX_REPLY_SIZE (hello with a 63-char name is the largest).
 #define SYNERGY_REPLY_BUFFER_SIZE 256
+#define SYNERGY_MAX_REPLY_SIZE 96
+// Largest frame the server may send (its own PROTOCOL_MAX_MESSAGE_LENGTH);
+// a longer length header means the stream is corrupt and the session is dropped.
+#define SYNERGY_MAX_MESSAGE_SIZE (4UL * 1024 * 1024)
+// The server hello is the first frame and is only a protocol name plus version
+#define SYNERGY_MAX_HELLO_SIZE 64
+// Socket reads remembered for timing frames from the read that delivered
+// their first byte; past this many unconsumed reads the newest absorbs the rest
+#define SYNERGY_RX_MARKS 8
+
+// Big-endian FourCC of a 4-character command literal, e.g. fourcc("DMMV")
+constexpr uint32_t fourcc(const char* s) {
+    return ((uint32_t)(uint8_t)s[0] << 24) | ((uint32_t)(uint8_t)s[1] << 16) |
+           ((uint32_t)(uint8_t)s[2] << 8) | (uint32_t)(uint8_t)s[3];
+}
+
+// Message registry: X(command, minimum argument bytes after the FourCC,
+// protocol minor version that introduced it, handler).
+// This is the one place new message types are added; processMessage() dispatches
+// through a switch generated from it. Frames shorter than the minimum are dropped,
+// and messages newer than the negotiated version are treated as unknown.
+#define SYNERGY_MESSAGES(X)                     \
+    X(DMMV, 4, 0, handleMouseMove)              \
+    X(DMRM, 4, 2, handleMouseRelativeMove)      \
+    X(DMDN, 1, 0, handleMouseDown)              \
+    X(DMUP, 1, 0, handleMouseUp)                \
+    X(DMWM, 4, 0, handleMouseWheel)             \
+    X(DKDN, 6, 0, handleKeyDown)                \
+    X(DKUP, 6, 0, handleKeyUp)                  \
+    X(DKRP, 8, 0, handleKeyRepeat)              \
+    X(CALV, 0, 3, handleKeepAlive)              \
+    X(QINF, 0, 0, handleQueryInfo)              \
+    X(CINN, 0, 0, handleEnter)                  \
+    X(COUT, 0, 0, handleLeave)                  \
+    X(CIAK, 0, 0, handleIgnored)                \
+    X(CROP, 0, 0, handleResetOptions)           \
+    X(DSOP, 4, 0, handleSetOptions)             \
+    X(CNOP, 0, 0, handleIgnored)                \
+    X(DCLP, 10, 6, handleClipboard)             \
+    X(SECN, 4, 7, handleSecureInput)            \
+    X(LSYN, 4, 8, handleLanguageSync)           \
+    X(EUNK, 0, 0, handleUnknownClient)          \
+    X(EBSY, 0, 0, handleBusy)                   \
+    X(EBAD, 0, 0, handleBadVersion)
+
+// Dense index of each registered message, plus a bucket for everything else
+enum MessageId : uint8_t {
+#define SYNERGY_MESSAGE_ID(name, minArgs, minMinor, handler) MSG_##name,
+    SYNERGY_MESSAGES(SYNERGY_MESSAGE_ID)
+#undef SYNERGY_MESSAGE_ID
+    MSG_UNKNOWN,
+    MSG_COUNT
+};
+
+// Per-command traffic (monotonic since boot)
+struct MessageCounter {
+    uint32_t count;
+    uint32_t bytes;          // Whole frames, including the length header
+    uint32_t lastSeenMs;     // millis() of the most recent one
+    uint32_t handlerMicros;  // Time spent decoding and in callbacks
+};
+
+// Capabilities implied by the negotiated protocol version
+enum Feature : uint16_t {
+    FEATURE_RELATIVE_MOVES = 1 << 0,  // 1.2: DMRM
+    FEATURE_KEEPALIVE      = 1 << 1,  // 1.3: CALV heartbeat
+    FEATURE_OPTIONS        = 1 << 2,  // DSOP server options
+    FEATURE_CLIPBOARD_CHUNKS = 1 << 3, // 1.6: DCLP start/chunk/end marks
+    FEATURE_SECURE_INPUT   = 1 << 4,  // 1.7: SECN notifications
+    FEATURE_LANGUAGE_SYNC  = 1 << 5,  // 1.8: LSYN server keyboard languages
+};
 
 // Callbacks
 typedef void (*MouseCallback)(int16_t x, int16_t y, int16_t wheelX, int16_t wheelY, 
                                bool btnLeft, bool btnMiddle, bool btnRight);
-typedef void (*KeyboardCallback)(uint16_t key, uint16_t modifiers, bool down, bool repeat);
+// Relative motion (DMRM) with the current button state
+typedef void (*RelativeMouseCallback)(int16_t dx, int16_t dy,
+                                      bool btnLeft, bool btnMiddle, bool btnRight);
+// keyId is the character (Unicode) or Synergy special-key id; button is the
+// server's scancode for the physical key, stable between down and up
+typedef void (*KeyboardCallback)(uint16_t keyId, uint16_t modifiers, uint16_t button,
+                                 bool down, bool repeat);
 typedef void (*ScreenActiveCallback)(bool active);
+// Clipboard text, delivered incrementally as it streams in. A final call with
+// len == 0 and final == true marks the end of one clipboard transfer.
+typedef void (*ClipboardCallback)(uint8_t id, const uint8_t* data, size_t len, bool final);
+
+// Screen geometry reported to the server in DINF; the server uses it for
+// edge detection and to clamp absolute moves
+struct ScreenGeometry {
+    int16_t x;        // Top-left corner in the controlled machine's coordinates
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+};
+
+// Server options (DSOP) this client acts on or reports. Reset to defaults on
+// CROP and on every new session.
+struct ServerOptions {
+    bool hasHeartbeat;         // HART was sent; otherwise setKeepAlivePeriod() applies
+    uint32_t heartbeatMs;      // HART: server keep-alive period (0 = keep-alives off)
+    bool relativeMouseMoves;   // MDLT: DMRM instead of DMMV while locked to this screen
+    bool screenSaverSync;      // SSVR
+    bool clipboardSharing;     // CLPS (default on)
+    bool halfDuplexCapsLock;   // HDCL/HDNL/HDSL: lock keys sent as press-only toggles
+    bool halfDuplexNumLock;
+    bool halfDuplexScrollLock;
+};
+
+// Receive path counters (monotonic since boot)
+struct Stats {
+    uint32_t socketReads;   // Client::read() calls that returned data, i.e. W5500 SPI bursts
+    uint32_t emptyPolls;    // Client::read() calls that found the socket empty
+    uint32_t bytesReceived; // Bytes pulled from the socket
+    uint32_t messages;      // Frames dispatched (including hello)
+    uint32_t replyWrites;   // Client::write() calls for staged replies
+    uint32_t keepAliveTimeouts; // Connections dropped for missing keep-alives
+    uint32_t malformed;     // Known messages too short for their arguments (dropped)
+    uint32_t protocolErrors; // Connections dropped for a bad hello or frame length
+};
+
+// Why update() asked the caller to drop the TCP connection
+enum DropReason : uint8_t {
+    DROP_NONE,
+    DROP_KEEPALIVE,  // Nothing received for the keep-alive deadline
+    DROP_PROTOCOL,   // Not a Synergy server, or a corrupt frame length
+};
 
 class SynergyClient {
 public:
     SynergyClient();
     
     void setClientName(const char* name);
-    void setScreenSize(uint16_t width, uint16_t height);
+    // Re-announced with an unsolicited DINF on the next update() if connected
+    void setScreenGeometry(const ScreenGeometry& geometry);
+    const ScreenGeometry& screenGeometry() const { return _screen; }
+    
+    // Dead-server detection: drop the session after periodMs * multiple of silence.
+    // A heartbeat option (DSOP HART) from the server overrides the period.
+    void setKeepAlivePeriod(uint32_t periodMs) { _keepAlivePeriodMs = periodMs; }
+    void setKeepAliveMultiple(uint8_t multiple) { _keepAliveMultiple = multiple ? multiple : 1; }
     
     void setMouseCallback(MouseCallback cb) { _mouseCallback = cb; }
+    void setRelativeMouseCallback(RelativeMouseCallback cb) { _relativeMouseCallback = cb; }
     void setKeyboardCallback(KeyboardCallback cb) { _keyboardCallback = cb; }
     void setScreenActiveCallback(ScreenActiveCallback cb) { _screenActiveCallback = cb; }
+    void setClipboardCallback(ClipboardCallback cb) { _clipboardCallback = cb; }
     
     // Call with connected client; returns false on disconnect/error
     bool update(Client& client);
     
+    // Set once after update() gave up on the session (silent server or corrupt
+    // stream); the caller should drop the TCP connection and reconnect right away.
+    // Returns DROP_NONE otherwise.
+    DropReason takeDropReason();
+    
     // Reset client state (call when TCP connection drops)
     void resetState() { reset(); }
     
     bool isConnected() const { return _connected; }
     bool isCaptured() const { return _captured; }
+    // The server took us as a screen: it sent QINF, CALV or CINN. A server
+    // that rejects the hello (EUNK, EBSY) never gets this far.
+    bool isAccepted() const { return _accepted; }
+    
+    // Negotiated session (valid once connected)
+    const char* serverProtocol() const { return _serverProtocol; }  // "Synergy", "Barrier" or "Deskflow"
+    uint16_t protocolMinor() const { return _protocolMinor; }
+    uint16_t features() const { return _features; }
+    bool hasFeature(Feature f) const { return (_features & f) != 0; }
+    // Options from the server's last DSOP
+    const ServerOptions& serverOptions() const { return _options; }
+    // Server keyboard languages from LSYN, e.g. "ende" (empty if not sent)
+    const char* serverLanguages() const { return _serverLanguages; }
+    // Comma-separated names of the bits in features, for logs and the dashboard
+    static String featureNames(uint16_t features);
+    
+    // Cursor position as last set by the server (CINN entry point or DMMV)
+    int16_t cursorX() const { return _mouseX; }
+    int16_t cursorY() const { return _mouseY; }
+    
+    const Stats& stats() const { return _stats; }
+    
+    // Traffic per command, indexed by MessageId
+    const MessageCounter& messageCounter(MessageId id) const { return _messageCounters[id]; }
+    static const char* messageName(MessageId id);
+    
+    // Trace points for the frame currently being handled (latency::now() clock):
+    // when the read that delivered its first byte drained the socket and when
+    // decoding started. Valid inside callbacks.
+    uint32_t frameReceivedMicros() const { return _rxMicros; }
+    uint32_t frameDecodedMicros() const { return _decodeMicros; }
     
 private:
     void reset();
-    bool sendReply(Client& client);
+    void resetOptions();
+    void dropConnection(DropReason reason);
+    uint32_t keepAliveDeadlineMs() const;
+    
+    // Reply staging: beginReply(), add*(), queueReply(); flushReplies() sends all
+    void beginReply(Client& client);
+    bool queueReply();
+    bool flushReplies(Client& client);
+    bool replyRoom(size_t len);
+    
+    bool processHello(Client& client, const uint8_t* msg, uint32_t len);
     void processMessage(Client& client, const uint8_t* msg, uint32_t len);
+    void notifyMouse();
+    void sendScreenInfo(Client& client);
+    void handleMalformed(const uint8_t* cmd, uint32_t argLen);
+    void countMessage(MessageId id, uint32_t bytes, uint32_t startMicros);
+    static MessageId messageIdFor(uint32_t code);
+    
+    // Message handlers (args points just past the FourCC)
+    void handleMouseMove(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleMouseRelativeMove(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleMouseDown(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleMouseUp(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleMouseWheel(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleKeyDown(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleKeyUp(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleKeyRepeat(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleKeepAlive(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleQueryInfo(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleEnter(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleLeave(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleClipboard(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleSecureInput(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleLanguageSync(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleIgnored(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleResetOptions(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleSetOptions(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleUnknownClient(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleBusy(Client& client, const uint8_t* args, uint32_t argLen);
+    void handleBadVersion(Client& client, const uint8_t* args, uint32_t argLen);
+    
+    // Receive ring helpers (indices are free-running, masked on access)
+    uint32_t recvUsed() const { return _recvHead - _recvTail; }
+    uint32_t recvFree() const { return SYNERGY_RECV_BUFFER_SIZE - recvUsed(); }
+    uint32_t fillRecvBuffer(Client& client);
+    uint32_t frameArrival(uint32_t start);
+    void peekRecv(uint32_t offset, uint8_t* dst, uint32_t len) const;
+    uint32_t peekFrameLength() const;
+    const uint8_t* frameView(uint32_t len);
+    bool beginOversized(uint32_t msgLen);
+    void drainOversized();
+    
+    // Clipboard streaming (DCLP chunk marks and serialized clipboard formats)
+    void clipboardChunk(uint8_t id, uint8_t mark, uint32_t dataLen);
+    void clipboardFeed(const uint8_t* data, uint32_t len);
     
     void addString(const char* str);
     void addUInt8(uint8_t val);
@@ -57,32 +290,81 @@ private:
     
     static int16_t netToNative16(const uint8_t* data);
     static int32_t netToNative32(const uint8_t* data);
+    static void readString(const uint8_t* args, uint32_t argLen, char* out, size_t outSize);
     
     char _clientName[64];
-    uint16_t _screenWidth;
-    uint16_t _screenHeight;
+    ScreenGeometry _screen;
+    bool _screenInfoDirty; // Geometry changed since the last DINF
     
     bool _connected;
     bool _hasReceivedHello;
     bool _captured;
+    bool _accepted;
     uint32_t _sequenceNumber;
     
+    // Negotiated in processHello()
+    const char* _serverProtocol;
+    uint16_t _protocolMinor;
+    uint16_t _features;
+    char _serverLanguages[33];
+    
+    // Keep-alive deadline
+    uint32_t _keepAlivePeriodMs;
+    uint8_t _keepAliveMultiple;
+    unsigned long _lastReceiveMs; // Last time any frame arrived
+    ServerOptions _options;
+    DropReason _dropReason;
+    
     uint8_t _recvBuffer[SYNERGY_RECV_BUFFER_SIZE];
-    int _recvOfs;
-    uint32_t _skipBytes; // Bytes remaining to skip for oversized packet
+    uint32_t _recvHead;  // Write index (next byte from socket)
+    uint32_t _recvTail;  // Read index (start of next frame)
+    uint32_t _skipBytes; // Bytes remaining of an oversized frame still to drain
+    bool _skipToClipboard; // Drained bytes feed the clipboard parser instead of being dropped
+    uint8_t _frameBuffer[SYNERGY_MAX_FRAME_SIZE]; // Linearized copy of a wrapped frame
+    
+    Stats _stats;
+    MessageCounter _messageCounters[MSG_COUNT];
+    uint32_t _rxMicros;
+    uint32_t _decodeMicros;
+    
+    // Reads not yet fully consumed: ring index just past each one's data, and
+    // when it drained the socket
+    struct RxMark {
+        uint32_t end;
+        uint32_t micros;
+    } _rxMarks[SYNERGY_RX_MARKS];
+    uint8_t _rxMarkCount;
     
     uint8_t _replyBuffer[SYNERGY_REPLY_BUFFER_SIZE];
-    uint8_t* _replyCur;
+    size_t _replyStart;   // Offset of the frame being built (end of staged frames)
+    size_t _replyPos;     // Write offset within the frame being built
+    bool _replyOverflow;  // Current frame didn't fit and will be dropped
     
     // Mouse state
     int16_t _mouseX, _mouseY;
     int16_t _mouseWheelX, _mouseWheelY;
     bool _mouseLeft, _mouseMiddle, _mouseRight;
     
+    // Clipboard stream state. The serialized clipboard is
+    // [count(4)] then per format [format(4)][size(4)][data], split across chunks.
+    struct ClipboardStream {
+        bool active;          // Between start (mark 1) and end (mark 3)
+        uint8_t id;           // Clipboard id (0 = clipboard, 1 = selection)
+        uint8_t state;        // Which field of the serialized clipboard is next
+        uint8_t fieldLen;     // Bytes collected into field[]
+        uint8_t field[4];
+        uint32_t formatsLeft;
+        uint32_t format;
+        uint32_t dataLeft;    // Bytes left in the current format's data
+        uint32_t chunkLeft;   // Bytes left in the current DCLP chunk's data string
+    } _clip;
+    
     // Callbacks
     MouseCallback _mouseCallback;
+    RelativeMouseCallback _relativeMouseCallback;
     KeyboardCallback _keyboardCallback;
     ScreenActiveCallback _screenActiveCallback;
+    ClipboardCallback _clipboardCallback;
 };
 
 } // namespace synergy
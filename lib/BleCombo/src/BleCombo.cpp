@@ -0,0 +1,225 @@
+/**
+ * BLE HID keyboard + mouse — implementation
+ */
+
+#include "BleCombo.h"
+
+static_assert(BLE_COMBO_NKRO_USAGES == 0x90, "Report map below hard-codes the NKRO usage range");
+
+// GATT UUID of the Boot Mouse Input Report (NimBLEHIDDevice only makes the keyboard ones)
+static const uint16_t BOOT_MOUSE_INPUT_UUID = 0x2a33;
+
+static const uint8_t REPORT_MAP[] = {
+    // Keyboard, boot layout (report ID 1)
+    0x05, 0x01,        // Usage Page (Generic Desktop)
+    0x09, 0x06,        // Usage (Keyboard)
+    0xA1, 0x01,        // Collection (Application)
+    0x85, BLE_COMBO_KEYBOARD_ID,
+    0x05, 0x07,        //   Usage Page (Keyboard/Keypad)
+    0x19, 0xE0,        //   Usage Minimum (Left Control)
+    0x29, 0xE7,        //   Usage Maximum (Right GUI)
+    0x15, 0x00,        //   Logical Minimum (0)
+    0x25, 0x01,        //   Logical Maximum (1)
+    0x75, 0x01,        //   Report Size (1)
+    0x95, 0x08,        //   Report Count (8)
+    0x81, 0x02,        //   Input (Data, Variable, Absolute): modifiers
+    0x95, 0x01,        //   Report Count (1)
+    0x75, 0x08,        //   Report Size (8)
+    0x81, 0x01,        //   Input (Constant): reserved
+    0x95, 0x05,        //   Report Count (5)
+    0x75, 0x01,        //   Report Size (1)
+    0x05, 0x08,        //   Usage Page (LEDs)
+    0x19, 0x01,        //   Usage Minimum (Num Lock)
+    0x29, 0x05,        //   Usage Maximum (Kana)
+    0x91, 0x02,        //   Output (Data, Variable, Absolute): LEDs
+    0x95, 0x01,        //   Report Count (1)
+    0x75, 0x03,        //   Report Size (3)
+    0x91, 0x01,        //   Output (Constant): padding
+    0x95, 0x06,        //   Report Count (6)
+    0x75, 0x08,        //   Report Size (8)
+    0x15, 0x00,        //   Logical Minimum (0)
+    0x26, 0xFF, 0x00,  //   Logical Maximum (255)
+    0x05, 0x07,        //   Usage Page (Keyboard/Keypad)
+    0x19, 0x00,        //   Usage Minimum (0)
+    0x2A, 0xFF, 0x00,  //   Usage Maximum (255)
+    0x81, 0x00,        //   Input (Data, Array): six key slots
+    0xC0,              // End Collection
+
+    // Mouse (report ID 2)
+    0x05, 0x01,        // Usage Page (Generic Desktop)
+    0x09, 0x02,        // Usage (Mouse)
+    0xA1, 0x01,        // Collection (Application)
+    0x85, BLE_COMBO_MOUSE_ID,
+    0x09, 0x01,        //   Usage (Pointer)
+    0xA1, 0x00,        //   Collection (Physical)
+    0x05, 0x09,        //     Usage Page (Buttons)
+    0x19, 0x01,        //     Usage Minimum (1)
+    0x29, 0x05,        //     Usage Maximum (5)
+    0x15, 0x00,        //     Logical Minimum (0)
+    0x25, 0x01,        //     Logical Maximum (1)
+    0x95, 0x05,        //     Report Count (5)
+    0x75, 0x01,        //     Report Size (1)
+    0x81, 0x02,        //     Input (Data, Variable, Absolute): buttons
+    0x95, 0x01,        //     Report Count (1)
+    0x75, 0x03,        //     Report Size (3)
+    0x81, 0x03,        //     Input (Constant): padding
+    0x05, 0x01,        //     Usage Page (Generic Desktop)
+    0x09, 0x30,        //     Usage (X)
+    0x09, 0x31,        //     Usage (Y)
+    0x09, 0x38,        //     Usage (Wheel)
+    0x15, 0x81,        //     Logical Minimum (-127)
+    0x25, 0x7F,        //     Logical Maximum (127)
+    0x75, 0x08,        //     Report Size (8)
+    0x95, 0x03,        //     Report Count (3)
+    0x81, 0x06,        //     Input (Data, Variable, Relative): X, Y, wheel
+    0x05, 0x0C,        //     Usage Page (Consumer)
+    0x0A, 0x38, 0x02,  //     Usage (AC Pan)
+    0x15, 0x81,        //     Logical Minimum (-127)
+    0x25, 0x7F,        //     Logical Maximum (127)
+    0x75, 0x08,        //     Report Size (8)
+    0x95, 0x01,        //     Report Count (1)
+    0x81, 0x06,        //     Input (Data, Variable, Relative): horizontal wheel
+    0xC0,              //   End Collection
+    0xC0,              // End Collection
+
+    // Keyboard, N-key rollover (report ID 3)
+    0x05, 0x01,        // Usage Page (Generic Desktop)
+    0x09, 0x06,        // Usage (Keyboard)
+    0xA1, 0x01,        // Collection (Application)
+    0x85, BLE_COMBO_NKRO_ID,
+    0x05, 0x07,        //   Usage Page (Keyboard/Keypad)
+    0x19, 0xE0,        //   Usage Minimum (Left Control)
+    0x29, 0xE7,        //   Usage Maximum (Right GUI)
+    0x15, 0x00,        //   Logical Minimum (0)
+    0x25, 0x01,        //   Logical Maximum (1)
+    0x75, 0x01,        //   Report Size (1)
+    0x95, 0x08,        //   Report Count (8)
+    0x81, 0x02,        //   Input (Data, Variable, Absolute): modifiers
+    0x19, 0x00,        //   Usage Minimum (0)
+    0x29, 0x8F,        //   Usage Maximum (0x8F)
+    0x95, 0x90,        //   Report Count (144)
+    0x81, 0x02,        //   Input (Data, Variable, Absolute): one bit per key
+    0xC0,              // End Collection
+};
+
+BleComboDevice::BleComboDevice()
+    : _name("ESP32 Keyboard/Mouse")
+    , _manufacturer("Espressif")
+    , _batteryLevel(100)
+    , _delayMs(0)
+    , _hid(nullptr)
+    , _keyboardInput(nullptr)
+    , _keyboardOutput(nullptr)
+    , _mouseInput(nullptr)
+    , _nkroInput(nullptr)
+    , _bootKeyboardInput(nullptr)
+    , _bootKeyboardOutput(nullptr)
+    , _bootMouseInput(nullptr)
+    , _protocolMode(nullptr)
+    , _connected(false)
+    , _bootProtocol(false)
+    , _leds(0)
+{
+}
+
+void BleComboDevice::setName(const char* name) {
+    _name = name;
+}
+
+void BleComboDevice::setManufacturer(const char* manufacturer) {
+    _manufacturer = manufacturer;
+}
+
+void BleComboDevice::setBatteryLevel(uint8_t level) {
+    _batteryLevel = level;
+    if (_hid) _hid->setBatteryLevel(level);
+}
+
+void BleComboDevice::begin() {
+    NimBLEDevice::init(_name);
+    NimBLEServer* server = NimBLEDevice::createServer();
+    server->setCallbacks(this, false);
+
+    _hid = new NimBLEHIDDevice(server);
+    _keyboardInput = _hid->inputReport(BLE_COMBO_KEYBOARD_ID);
+    _keyboardOutput = _hid->outputReport(BLE_COMBO_KEYBOARD_ID);
+    _mouseInput = _hid->inputReport(BLE_COMBO_MOUSE_ID);
+    _nkroInput = _hid->inputReport(BLE_COMBO_NKRO_ID);
+    _bootKeyboardInput = _hid->bootInput();
+    _bootKeyboardOutput = _hid->bootOutput();
+    _bootMouseInput = _hid->hidService()->createCharacteristic(
+        BOOT_MOUSE_INPUT_UUID, NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+    _protocolMode = _hid->protocolMode();
+
+    _keyboardOutput->setCallbacks(this);
+    _bootKeyboardOutput->setCallbacks(this);
+    _protocolMode->setCallbacks(this);
+
+    _hid->manufacturer()->setValue(_manufacturer);
+    _hid->pnp(0x02, 0xe502, 0xa111, 0x0210);
+    _hid->hidInfo(0x00, 0x01);
+
+    NimBLEDevice::setSecurityAuth(true, true, true);
+
+    _hid->reportMap((uint8_t*)REPORT_MAP, sizeof(REPORT_MAP));
+    _hid->startServices();
+    _hid->setBatteryLevel(_batteryLevel);
+
+    NimBLEAdvertising* advertising = server->getAdvertising();
+    advertising->setAppearance(HID_KEYBOARD);
+    advertising->addServiceUUID(_hid->hidService()->getUUID());
+    advertising->setScanResponse(false);
+    advertising->start();
+}
+
+bool BleComboDevice::notify(NimBLECharacteristic* characteristic, const uint8_t* data, size_t len) {
+    if (!characteristic || !isConnected()) return false;
+    characteristic->setValue(data, len);
+    characteristic->notify();
+    if (_delayMs) delay(_delayMs);
+    return true;
+}
+
+bool BleComboDevice::sendKeyboard(const uint8_t* report) {
+    return notify(bootProtocol() ? _bootKeyboardInput : _keyboardInput, report, BLE_COMBO_KEYBOARD_SIZE);
+}
+
+bool BleComboDevice::sendNkro(const uint8_t* report) {
+    if (bootProtocol()) return false;
+    return notify(_nkroInput, report, BLE_COMBO_NKRO_SIZE);
+}
+
+bool BleComboDevice::sendMouse(uint8_t buttons, int8_t x, int8_t y, int8_t wheel, int8_t hWheel) {
+    if (bootProtocol()) {
+        // Boot mouse: buttons, X, Y
+        uint8_t boot[3] = { buttons, (uint8_t)x, (uint8_t)y };
+        return notify(_bootMouseInput, boot, sizeof(boot));
+    }
+    uint8_t report[5] = { buttons, (uint8_t)x, (uint8_t)y, (uint8_t)wheel, (uint8_t)hWheel };
+    return notify(_mouseInput, report, sizeof(report));
+}
+
+void BleComboDevice::onConnect(NimBLEServer* server) {
+    (void)server;
+    // HID over GATT: every connection starts in report protocol
+    static const uint8_t REPORT_PROTOCOL = 0x01;
+    _protocolMode->setValue(&REPORT_PROTOCOL, 1);
+    _bootProtocol.store(false, std::memory_order_release);
+    _connected.store(true, std::memory_order_release);
+}
+
+void BleComboDevice::onDisconnect(NimBLEServer* server) {
+    (void)server;
+    // NimBLE restarts advertising on its own
+    _connected.store(false, std::memory_order_release);
+}
+
+void BleComboDevice::onWrite(NimBLECharacteristic* characteristic) {
+    uint8_t value = characteristic->getValue<uint8_t>();
+    if (characteristic == _protocolMode) {
+        // 0 = boot protocol, 1 = report protocol
+        _bootProtocol.store(value == 0x00, std::memory_order_release);
+    } else if (characteristic == _keyboardOutput || characteristic == _bootKeyboardOutput) {
+        _leds.store(value, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,107 @@
+/**
+ * BLE HID keyboard + mouse as a single NimBLE peripheral
+ * Takes the place of ESP32-BLE-Combo, whose report map is fixed and whose
+ * HID characteristics are private, so the map can carry an N-key rollover
+ * keyboard next to the boot-compatible one and the protocol mode the host
+ * picks is honored.
+ *
+ * Report protocol (the default on every connection):
+ *   ID 1  Keyboard, boot layout: modifiers, reserved, six keys; LED output
+ *   ID 2  Mouse: five buttons, X, Y, wheel, horizontal wheel
+ *   ID 3  Keyboard, N-key rollover: modifiers, one bit per usage 0x00-0x8F
+ * Boot protocol (BIOS, boot loaders) uses the Boot Keyboard Input/Output and
+ * Boot Mouse Input characteristics instead; only the boot keyboard layout and
+ * buttons/X/Y are sent there.
+ */
+
+#ifndef BLE_COMBO_H
+#define BLE_COMBO_H
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <NimBLEHIDDevice.h>
+#include <atomic>
+
+#define BLE_COMBO_KEYBOARD_ID 0x01
+#define BLE_COMBO_MOUSE_ID    0x02
+#define BLE_COMBO_NKRO_ID     0x03
+
+#define BLE_COMBO_KEYBOARD_SIZE 8
+// Modifier byte + 144 usage bits: 19 bytes, one notification at the default MTU
+#define BLE_COMBO_NKRO_USAGES   0x90
+#define BLE_COMBO_NKRO_SIZE     (1 + BLE_COMBO_NKRO_USAGES / 8)
+
+#define MOUSE_LEFT    0x01
+#define MOUSE_RIGHT   0x02
+#define MOUSE_MIDDLE  0x04
+#define MOUSE_BACK    0x08
+#define MOUSE_FORWARD 0x10
+
+class BleComboDevice : public NimBLEServerCallbacks, public NimBLECharacteristicCallbacks {
+public:
+    BleComboDevice();
+
+    /** Set before begin(). */
+    void setName(const char* name);
+    void setManufacturer(const char* manufacturer);
+    void setBatteryLevel(uint8_t level);
+
+    /** Pause after each report so bursts don't run the stack out of buffers (ms). */
+    void setDelay(uint32_t ms) { _delayMs = ms; }
+
+    /** Create the HID services and start advertising. */
+    void begin();
+
+    bool isConnected() const { return _connected.load(std::memory_order_acquire); }
+
+    /** The host selected the boot protocol. Back to report protocol on every connection. */
+    bool bootProtocol() const { return _bootProtocol.load(std::memory_order_acquire); }
+
+    /** Keyboard LEDs (bit 0 Num Lock, 1 Caps Lock, 2 Scroll Lock) as last set by the host. */
+    uint8_t leds() const { return _leds.load(std::memory_order_relaxed); }
+
+    /**
+     * Send the 8-byte boot layout keyboard report: report ID 1, or the boot
+     * keyboard characteristic in boot protocol. False if no host is connected.
+     */
+    bool sendKeyboard(const uint8_t* report);
+
+    /**
+     * Send the BLE_COMBO_NKRO_SIZE-byte N-key rollover report (report ID 3).
+     * False if no host is connected or it is in boot protocol, where this
+     * report doesn't exist; send the boot report instead.
+     */
+    bool sendNkro(const uint8_t* report);
+
+    /** Send a mouse report; in boot protocol the wheels are left out. */
+    bool sendMouse(uint8_t buttons, int8_t x, int8_t y, int8_t wheel, int8_t hWheel = 0);
+
+    // NimBLE callbacks (host task)
+    void onConnect(NimBLEServer* server) override;
+    void onDisconnect(NimBLEServer* server) override;
+    void onWrite(NimBLECharacteristic* characteristic) override;
+
+private:
+    bool notify(NimBLECharacteristic* characteristic, const uint8_t* data, size_t len);
+
+    std::string _name;
+    std::string _manufacturer;
+    uint8_t _batteryLevel;
+    uint32_t _delayMs;
+
+    NimBLEHIDDevice* _hid;
+    NimBLECharacteristic* _keyboardInput;
+    NimBLECharacteristic* _keyboardOutput;
+    NimBLECharacteristic* _mouseInput;
+    NimBLECharacteristic* _nkroInput;
+    NimBLECharacteristic* _bootKeyboardInput;
+    NimBLECharacteristic* _bootKeyboardOutput;
+    NimBLECharacteristic* _bootMouseInput;
+    NimBLECharacteristic* _protocolMode;
+
+    std::atomic<bool> _connected;
+    std::atomic<bool> _bootProtocol;
+    std::atomic<uint8_t> _leds;
+};
+
+#endif // BLE_COMBO_H
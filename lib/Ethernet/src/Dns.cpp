@@ -44,10 +44,16 @@
 #define TRUNCATED        -3
 #define INVALID_RESPONSE -4
 
+// Non-blocking lookup states
+#define LOOKUP_IDLE      0
+#define LOOKUP_WAITING   1
+#define LOOKUP_NUMERIC   2
+
 void DNSClient::begin(const IPAddress& aDNSServer)
 {
 	iDNSServer = aDNSServer;
 	iRequestId = 0;
+	cancelLookup();
 }
 
 
@@ -134,6 +140,72 @@ int DNSClient::getHostByName(const char* aHostname, IPAddress& aResult, uint16_t
 	return ret;
 }
 
+int DNSClient::beginLookup(const char* aHostname, uint16_t aTimeout)
+{
+	cancelLookup();
+
+	if (inet_aton(aHostname, iLookupResult)) {
+		iLookupState = LOOKUP_NUMERIC;
+		return 1;
+	}
+	if (iDNSServer == INADDR_NONE) {
+		return INVALID_SERVER;
+	}
+	if (iUdp.begin(1024+(millis() & 0xF)) != 1) {
+		return 0;
+	}
+	if (iUdp.beginPacket(iDNSServer, DNS_PORT) == 0 ||
+	    BuildRequest(aHostname) == 0 ||
+	    iUdp.endPacket() == 0) {
+		iUdp.stop();
+		return 0;
+	}
+	iLookupState = LOOKUP_WAITING;
+	iLookupStart = millis();
+	iLookupTimeout = aTimeout;
+	return 1;
+}
+
+int DNSClient::pollLookup(IPAddress& aResult, uint32_t* aTtl)
+{
+	if (iLookupState == LOOKUP_NUMERIC) {
+		iLookupState = LOOKUP_IDLE;
+		aResult = iLookupResult;
+		if (aTtl) *aTtl = 0;
+		return SUCCESS;
+	}
+	if (iLookupState != LOOKUP_WAITING) {
+		return INVALID_RESPONSE;
+	}
+
+	// Drain whatever has arrived; stray or stale packets are skipped
+	while (iUdp.parsePacket() > 0) {
+		uint32_t ttl = 0;
+		int ret = ParseResponse(aResult, ttl);
+		if (ret == INVALID_SERVER || ret == INVALID_RESPONSE) {
+			iUdp.flush();
+			continue;
+		}
+		cancelLookup();
+		if (ret == SUCCESS && aTtl) *aTtl = ttl;
+		return ret;
+	}
+
+	if ((millis() - iLookupStart) > iLookupTimeout) {
+		cancelLookup();
+		return TIMED_OUT;
+	}
+	return 0;
+}
+
+void DNSClient::cancelLookup()
+{
+	if (iLookupState == LOOKUP_WAITING) {
+		iUdp.stop();
+	}
+	iLookupState = LOOKUP_IDLE;
+}
+
 uint16_t DNSClient::BuildRequest(const char* aName)
 {
 	// Build header
@@ -223,6 +295,12 @@ uint16_t DNSClient::ProcessResponse(uint16_t aTimeout, IPAddress& aAddress)
 		delay(50);
 	}
 
+	uint32_t ttl;
+	return ParseResponse(aAddress, ttl);
+}
+
+int DNSClient::ParseResponse(IPAddress& aAddress, uint32_t& aTtl)
+{
 	// We've had a reply!
 	// Read the UDP header
 	//uint8_t header[DNS_HEADER_SIZE]; // Enough space to reuse for the DNS header
@@ -322,8 +400,9 @@ uint16_t DNSClient::ProcessResponse(uint16_t aTimeout, IPAddress& aAddress)
 		iUdp.read((uint8_t*)&answerType, sizeof(answerType));
 		iUdp.read((uint8_t*)&answerClass, sizeof(answerClass));
 
-		// Ignore the Time-To-Live as we don't do any caching
-		iUdp.read((uint8_t *)NULL, TTL_SIZE); // don't care about the returned bytes
+		// Time-To-Live, for callers that cache the answer
+		uint32_t ttl = 0;
+		iUdp.read((uint8_t*)&ttl, TTL_SIZE);
 
 		// And read out the length of this answer
 		// Don't need header_flags anymore, so we can reuse it here
@@ -338,6 +417,7 @@ uint16_t DNSClient::ProcessResponse(uint16_t aTimeout, IPAddress& aAddress)
 			}
 			// FIXME: seems to lock up here on ESP8266, but why??
 			iUdp.read(aAddress.raw_address(), 4);
+			aTtl = ntohl(ttl);
 			return SUCCESS;
 		} else {
 			// This isn't an answer type we're after, move onto the next one
@@ -10,6 +10,8 @@
 class DNSClient
 {
 public:
+	DNSClient() : iRequestId(0), iLookupState(0), iLookupStart(0), iLookupTimeout(0) {}
+
 	void begin(const IPAddress& aDNSServer);
 
 	/** Convert a numeric IP address string into a four-byte IP address.
@@ -28,13 +30,40 @@ public:
 	*/
 	int getHostByName(const char* aHostname, IPAddress& aResult, uint16_t timeout=5000);
 
+	/** Start a non-blocking lookup: sends the query and returns at once.
+	    Numeric addresses complete immediately (pollLookup() returns them).
+	    @param aHostname Name to be resolved
+	    @param aTimeout How long pollLookup() waits for the answer (ms)
+	    @result 1 if the lookup was started, else error code
+	*/
+	int beginLookup(const char* aHostname, uint16_t aTimeout=5000);
+
+	/** Check on a lookup started with beginLookup(). Never blocks.
+	    @param aResult IPAddress structure to store the returned IP address
+	    @param aTtl If not NULL, receives the answer's time-to-live in seconds
+	                (0 for numeric addresses)
+	    @result 1 when resolved, 0 while still waiting, else error code
+	            (the lookup is over and its socket released)
+	*/
+	int pollLookup(IPAddress& aResult, uint32_t* aTtl=NULL);
+
+	/** Abandon a lookup started with beginLookup(). */
+	void cancelLookup();
+
 protected:
 	uint16_t BuildRequest(const char* aName);
 	uint16_t ProcessResponse(uint16_t aTimeout, IPAddress& aAddress);
+	int ParseResponse(IPAddress& aAddress, uint32_t& aTtl);
 
 	IPAddress iDNSServer;
 	uint16_t iRequestId;
 	EthernetUDP iUdp;
+
+	// Non-blocking lookup state
+	uint8_t iLookupState;
+	uint32_t iLookupStart;
+	uint16_t iLookupTimeout;
+	IPAddress iLookupResult;
 };
 
 #endif
@@ -213,13 +213,22 @@ public:
 
 class EthernetClient : public Client {
 public:
-	EthernetClient() : _sockindex(MAX_SOCK_NUM), _timeout(1000) { }
-	EthernetClient(uint8_t s) : _sockindex(s), _timeout(1000) { }
+	EthernetClient() : _sockindex(MAX_SOCK_NUM), _timeout(1000), _connecting(false), _connectStart(0) { }
+	EthernetClient(uint8_t s) : _sockindex(s), _timeout(1000), _connecting(false), _connectStart(0) { }
 	virtual ~EthernetClient() {};
 
 	uint8_t status();
 	virtual int connect(IPAddress ip, uint16_t port);
 	virtual int connect(const char *host, uint16_t port);
+	// Non-blocking connect: connectStart() sends the SYN and returns at once
+	// (1 = started, 0 = no free socket or bad address). Call connectPoll()
+	// until it returns 1 (established) or -1 (refused or no answer within the
+	// connection timeout; the socket is released). 0 means still in progress.
+	// connectCancel() closes the socket immediately: it abandons a pending
+	// connect, or drops a connection without stop()'s wait for the FIN.
+	int connectStart(IPAddress ip, uint16_t port);
+	int connectPoll();
+	void connectCancel();
 	virtual int availableForWrite(void);
 	virtual size_t write(uint8_t);
 	virtual size_t write(const uint8_t *buf, size_t size);
@@ -248,6 +257,8 @@ public:
 private:
 	uint8_t _sockindex; // MAX_SOCK_NUM means client not in use
 	uint16_t _timeout;
+	bool _connecting;        // connectStart() issued, connectPoll() not yet final
+	uint32_t _connectStart;
 };
 
 
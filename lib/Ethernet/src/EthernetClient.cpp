@@ -69,6 +69,49 @@ int EthernetClient::connect(IPAddress ip, uint16_t port)
 	return 0;
 }
 
+int EthernetClient::connectStart(IPAddress ip, uint16_t port)
+{
+	if (_sockindex < MAX_SOCK_NUM) {
+		if (Ethernet.socketStatus(_sockindex) != SnSR::CLOSED) {
+			Ethernet.socketDisconnect(_sockindex);
+		}
+		_sockindex = MAX_SOCK_NUM;
+	}
+	_connecting = false;
+#if defined(ESP8266) || defined(ESP32)
+	if (ip == IPAddress((uint32_t)0) || ip == IPAddress(0xFFFFFFFFul)) return 0;
+#else
+	if (ip == IPAddress(0ul) || ip == IPAddress(0xFFFFFFFFul)) return 0;
+#endif
+	_sockindex = Ethernet.socketBegin(SnMR::TCP, 0);
+	if (_sockindex >= MAX_SOCK_NUM) return 0;
+	Ethernet.socketConnect(_sockindex, rawIPAddress(ip), port);
+	_connecting = true;
+	_connectStart = millis();
+	return 1;
+}
+
+int EthernetClient::connectPoll()
+{
+	if (!_connecting) return (_sockindex < MAX_SOCK_NUM) ? 1 : -1;
+	uint8_t stat = Ethernet.socketStatus(_sockindex);
+	if (stat == SnSR::ESTABLISHED || stat == SnSR::CLOSE_WAIT) {
+		_connecting = false;
+		return 1;
+	}
+	if (stat != SnSR::CLOSED && millis() - _connectStart <= _timeout) return 0;
+	connectCancel();
+	return -1;
+}
+
+void EthernetClient::connectCancel()
+{
+	_connecting = false;
+	if (_sockindex >= MAX_SOCK_NUM) return;
+	Ethernet.socketClose(_sockindex);
+	_sockindex = MAX_SOCK_NUM;
+}
+
 int EthernetClient::availableForWrite(void)
 {
 	if (_sockindex >= MAX_SOCK_NUM) return 0;
@@ -6,174 +6,109 @@
 #include "../include/config.h"
 #include "../include/deskflow_server.h"
 #include "../include/synergy_protocol.h"
+#include "../include/input_queue.h"
+#include "../include/hid_keymap.h"
+#include "../include/keyboard_layout.h"
+#include "../include/latency.h"
 #include "../include/ble_hid.h"
 #include "../include/web_ui.h"
 #include "../include/device_name.h"
 #include <Ethernet.h>
+#include <Dns.h>
+#include <Preferences.h>
 
 namespace deskflow {
 
+// Remote Deskflow servers in priority order, each with its own backoff
+struct Endpoint {
+    String host;
+    uint16_t port;
+    uint8_t failures;          // Consecutive failed connects or lost sessions
+    unsigned long retryAtMs;   // Not tried again before this
+    
+    // Resolved address, reused across reconnects until its DNS TTL runs out
+    IPAddress addr;
+    bool addrValid;
+    bool addrNumeric;          // Host was an IP literal: never expires
+    unsigned long addrExpiresMs;
+};
+
 static EthernetClient _remoteClient;
-static String _remoteHost;
-static uint16_t _remotePort = 24800;  // Default Deskflow port
-static bool _useRemote = false;
-static unsigned long _lastConnectAttempt = 0;
+static Endpoint _endpoints[DESKFLOW_MAX_ENDPOINTS];
+static uint8_t _endpointCount = 0;
+static int8_t _activeEndpoint = -1;      // Endpoint _remoteClient is connecting/connected to
+static bool _resolving = false;          // DNS lookup in progress for the active endpoint
+static bool _connecting = false;         // TCP handshake in progress (connectStart issued)
+static DNSClient _dns;
+static String _endpointSpec;             // Last list given to setRemoteEndpoint()
+static unsigned long _connectedAtMs = 0; // TCP connect time (handshake deadline)
+static bool _sessionUp = false;          // Server hello completed on this connection
+static bool _sessionAccepted = false;    // Server accepted the screen on this connection
 
 static synergy::SynergyClient _synergy;
 static bool _initialized = false;
 
+// NVS namespace and keys for settings that survive a reboot
+static const char* PREFS_NAMESPACE = "deskflow";
+static const char* PREF_SCREEN_X = "scr_x";
+static const char* PREF_SCREEN_Y = "scr_y";
+static const char* PREF_SCREEN_W = "scr_w";
+static const char* PREF_SCREEN_H = "scr_h";
+static const char* PREF_KEYBOARD_LAYOUT = "kbd_layout";
+
+// Decoded input waiting for BLE HID. Producer: Synergy callbacks in poll().
+// Consumer: drainInput(), from the HID task or inline when it's disabled.
+static input_queue::SpscQueue _inputQueue;
+
 // Last mouse position for relative movement
 static int16_t _lastMouseX = 0;
 static int16_t _lastMouseY = 0;
 
-// IBM PC AT Scancode Set 1 to ASCII character mapping
-// Barrier/Deskflow sends hardware scancodes
-static const uint8_t scancodeToAscii[128] = {
-    0,    0x1B, '1',  '2',  '3',  '4',  '5',  '6',   // 00-07: ?, Esc, 1-6
-    '7',  '8',  '9',  '0',  '-',  '=',  0x08, 0x09,  // 08-0F: 7-0, -, =, Backspace, Tab
-    'q',  'w',  'e',  'r',  't',  'y',  'u',  'i',   // 10-17: Q-I
-    'o',  'p',  '[',  ']',  0x0D, 0xA0, 'a',  's',   // 18-1F: O, P, [, ], Enter, LCtrl, A, S
-    'd',  'f',  'g',  'h',  'j',  'k',  'l',  ';',   // 20-27: D-L, ;
-    '\'', '`',  0xA1, '\\', 'z',  'x',  'c',  'v',   // 28-2F: ', `, LShift, \, Z-V
-    'b',  'n',  'm',  ',',  '.',  '/',  0xA5, '*',   // 30-37: B-M, ,, ., /, RShift, KP*
-    0xA2, ' ',  0xAA, 0x80, 0x81, 0x82, 0x83, 0x84,  // 38-3F: LAlt, Space, CapsLock, F1-F5
-    0x85, 0x86, 0x87, 0x88, 0x89, 0,    0,    0xC7,  // 40-47: F6-F10, NumLock, ScrollLock, KP7
-    0xC8, 0xC9, '-',  0xC4, 0xC5, 0xC6, '+',  0xC1,  // 48-4F: KP8, KP9, KP-, KP4, KP5, KP6, KP+, KP1
-    0xC2, 0xC3, 0xC0, 0x7F, 0,    0,    0,    0x8A,  // 50-57: KP2, KP3, KP0, KP., ?, ?, NonUS\, F11
-    0x8B, 0,    0,    0,    0,    0,    0,    0,     // 58-5F: F12, ...
-    0,    0,    0,    0,    0,    0,    0,    0,     // 60-67
-    0,    0,    0,    0,    0,    0,    0,    0,     // 68-6F
-    0,    0,    0,    0,    0,    0,    0,    0,     // 70-77
-    0,    0,    0,    0,    0,    0,    0,    0,     // 78-7F
-};
-
-// Special key codes (0x80+ for F keys, 0xA0+ for modifiers, 0xB0+ for navigation)
-#define SPECIAL_F1      0x80
-#define SPECIAL_F2      0x81
-#define SPECIAL_F3      0x82
-#define SPECIAL_F4      0x83
-#define SPECIAL_F5      0x84
-#define SPECIAL_F6      0x85
-#define SPECIAL_F7      0x86
-#define SPECIAL_F8      0x87
-#define SPECIAL_F9      0x88
-#define SPECIAL_F10     0x89
-#define SPECIAL_F11     0x8A
-#define SPECIAL_F12     0x8B
-
-#define SPECIAL_LCTRL   0xA0
-#define SPECIAL_LSHIFT  0xA1
-#define SPECIAL_LALT    0xA2
-#define SPECIAL_LGUI    0xA3
-#define SPECIAL_RCTRL   0xA4
-#define SPECIAL_RSHIFT  0xA5
-#define SPECIAL_RALT    0xA6
-#define SPECIAL_RGUI    0xA7
-
-#define SPECIAL_HOME    0xB0
-#define SPECIAL_END     0xB1
-#define SPECIAL_PAGEUP  0xB2
-#define SPECIAL_PAGEDN  0xB3
-#define SPECIAL_INSERT  0xB4
-#define SPECIAL_DELETE  0xB5
-#define SPECIAL_UP      0xB6
-#define SPECIAL_DOWN    0xB7
-#define SPECIAL_LEFT    0xB8
-#define SPECIAL_RIGHT   0xB9
-
-// Convert Synergy/Barrier scancode to ASCII (or special key code)
-static uint8_t synergyToAscii(uint16_t synergyKey) {
-    // Check if it's a scancode (0x00-0x7F range)
-    if (synergyKey < 128) {
-        return scancodeToAscii[synergyKey];
-    }
-    
-    // Extended scancodes with 0x01xx prefix (Barrier's format for extended keys)
-    if ((synergyKey & 0xFF00) == 0x0100) {
-        uint8_t ext = synergyKey & 0xFF;
-        switch (ext) {
-            case 0x47: return SPECIAL_HOME;     // Home
-            case 0x4F: return SPECIAL_END;      // End
-            case 0x49: return SPECIAL_PAGEUP;   // Page Up
-            case 0x51: return SPECIAL_PAGEDN;   // Page Down
-            case 0x52: return SPECIAL_INSERT;   // Insert
-            case 0x53: return SPECIAL_DELETE;   // Delete
-            case 0x48: return SPECIAL_UP;       // Up arrow
-            case 0x50: return SPECIAL_DOWN;     // Down arrow
-            case 0x4B: return SPECIAL_LEFT;     // Left arrow
-            case 0x4D: return SPECIAL_RIGHT;    // Right arrow
-            case 0x1D: return SPECIAL_RCTRL;    // Right Ctrl
-            case 0x38: return SPECIAL_RALT;     // Right Alt
-            case 0x5B: return SPECIAL_LGUI;     // Left Windows
-            case 0x5C: return SPECIAL_RGUI;     // Right Windows
-            case 0x1C: return 0x0D;             // Numpad Enter
-            case 0x35: return '/';              // Numpad /
-        }
-    }
-    
-    // Extended scancodes (E0 prefix, alternative format)
-    if ((synergyKey & 0xFF00) == 0xE000) {
-        uint8_t ext = synergyKey & 0xFF;
-        switch (ext) {
-            case 0x47: return SPECIAL_HOME;
-            case 0x4F: return SPECIAL_END;
-            case 0x49: return SPECIAL_PAGEUP;
-            case 0x51: return SPECIAL_PAGEDN;
-            case 0x52: return SPECIAL_INSERT;
-            case 0x53: return SPECIAL_DELETE;
-            case 0x48: return SPECIAL_UP;
-            case 0x50: return SPECIAL_DOWN;
-            case 0x4B: return SPECIAL_LEFT;
-            case 0x4D: return SPECIAL_RIGHT;
-            case 0x1D: return SPECIAL_RCTRL;
-            case 0x38: return SPECIAL_RALT;
-            case 0x5B: return SPECIAL_LGUI;
-            case 0x5C: return SPECIAL_RGUI;
-        }
-    }
-    
-    // X11 keysym special keys (0xFFxx range)
-    switch (synergyKey) {
-        case 0xFF0D: return 0x0D;  // Return/Enter
-        case 0xFF1B: return 0x1B;  // Escape
-        case 0xFF08: return 0x08;  // BackSpace
-        case 0xFF09: return 0x09;  // Tab
-        case 0x0020: return ' ';   // Space
-        // Navigation keys (X11 keysyms)
-        case 0xFF50: return SPECIAL_HOME;
-        case 0xFF57: return SPECIAL_END;
-        case 0xFF55: return SPECIAL_PAGEUP;
-        case 0xFF56: return SPECIAL_PAGEDN;
-        case 0xFF63: return SPECIAL_INSERT;
-        case 0xFFFF: return SPECIAL_DELETE;
-        case 0xFF52: return SPECIAL_UP;
-        case 0xFF54: return SPECIAL_DOWN;
-        case 0xFF51: return SPECIAL_LEFT;
-        case 0xFF53: return SPECIAL_RIGHT;
-        // Modifiers (X11 keysyms)
-        case 0xFFE1: return SPECIAL_LSHIFT;
-        case 0xFFE2: return SPECIAL_RSHIFT;
-        case 0xFFE3: return SPECIAL_LCTRL;
-        case 0xFFE4: return SPECIAL_RCTRL;
-        case 0xFFE9: return SPECIAL_LALT;
-        case 0xFFEA: return SPECIAL_RALT;
-        case 0xFFEB: return SPECIAL_LGUI;
-        case 0xFFEC: return SPECIAL_RGUI;
-        default: return 0;
-    }
-}
-
-// Convert Synergy modifiers to HID modifiers
+// Convert Synergy modifiers to HID modifiers (lock states have no HID bit)
 static uint8_t synergyToHidMod(uint16_t synergyMod) {
     uint8_t hid = 0;
     if (synergyMod & 0x0001) hid |= 0x02;  // Shift -> Left Shift
     if (synergyMod & 0x0002) hid |= 0x01;  // Ctrl -> Left Ctrl
     if (synergyMod & 0x0004) hid |= 0x04;  // Alt -> Left Alt
     if (synergyMod & 0x0008) hid |= 0x08;  // Meta/Win -> Left GUI
+    if (synergyMod & 0x0010) hid |= 0x08;  // Super -> Left GUI
+    if (synergyMod & 0x0020) hid |= 0x40;  // AltGr -> Right Alt
     return hid;
 }
 
-// Mouse callback from Synergy protocol
+static uint8_t buttonMask(bool btnLeft, bool btnMiddle, bool btnRight) {
+    uint8_t buttons = 0;
+    if (btnLeft) buttons |= 0x01;
+    if (btnRight) buttons |= 0x02;
+    if (btnMiddle) buttons |= 0x04;
+    return buttons;
+}
+
+// Stamp an event with its frame's socket-drain time and record the decode and
+// dispatch trace points before handing it to the HID side
+static void queueEvent(input_queue::Event& ev) {
+    uint32_t rx = _synergy.frameReceivedMicros();
+    ev.rxMicros = rx;
+    latency::record(latency::STAGE_DECODE, _synergy.frameDecodedMicros() - rx);
+    // Motion is never refused (it coalesces); a refused key or button raises
+    // the queue's release request, which drainInput() acts on
+    _inputQueue.push(ev);
+    latency::record(latency::STAGE_DISPATCH, latency::now() - rx);
+}
+
+static void queueMouse(uint8_t buttons, int16_t dx, int16_t dy, int8_t wheel) {
+    // Full int16 deltas go into the queue; drainInput() splits them into
+    // int8 HID reports, so large jumps are not clamped away
+    input_queue::Event ev;
+    ev.type = input_queue::EVENT_MOUSE;
+    ev.mouse.buttons = buttons;
+    ev.mouse.wheel = wheel;
+    ev.mouse.dx = dx;
+    ev.mouse.dy = dy;
+    queueEvent(ev);
+}
+
+// Mouse callback from Synergy protocol (absolute DMMV, buttons, wheel)
 static void onMouse(int16_t x, int16_t y, int16_t wheelX, int16_t wheelY,
                     bool btnLeft, bool btnMiddle, bool btnRight) {
     // Calculate relative movement
@@ -182,18 +117,6 @@ static void onMouse(int16_t x, int16_t y, int16_t wheelX, int16_t wheelY,
     _lastMouseX = x;
     _lastMouseY = y;
     
-    // Clamp to int8 range
-    if (dx > 127) dx = 127;
-    if (dx < -127) dx = -127;
-    if (dy > 127) dy = 127;
-    if (dy < -127) dy = -127;
-    
-    // Build button mask
-    uint8_t buttons = 0;
-    if (btnLeft) buttons |= 0x01;
-    if (btnRight) buttons |= 0x02;
-    if (btnMiddle) buttons |= 0x04;
-    
     // Wheel is sent as delta in 120-unit increments (Windows standard)
     // Scale down to reasonable HID scroll amount
     int8_t wheel = 0;
@@ -205,91 +128,493 @@ static void onMouse(int16_t x, int16_t y, int16_t wheelX, int16_t wheelY,
         if (wheel == 0 && wheelY < 0) wheel = -1;
     }
     
-    ble_hid::mouseReport(buttons, (int8_t)dx, (int8_t)dy, wheel);
+    queueMouse(buttonMask(btnLeft, btnMiddle, btnRight), dx, dy, wheel);
+}
+
+// Relative mouse callback (DMRM): deltas go straight to BLE, no screen model
+static void onMouseRelative(int16_t dx, int16_t dy, bool btnLeft, bool btnMiddle, bool btnRight) {
+    queueMouse(buttonMask(btnLeft, btnMiddle, btnRight), dx, dy, 0);
+}
+
+// Keys the server has down, by button: scancodes (bank 0), E0/0x01xx
+// extended scancodes (bank 1) and 0xFFxx keysyms (bank 2). A release for a
+// button that isn't down is dropped; the release always maps the same button
+// the press did, so it names the same usage.
+static const uint16_t KEY_STATE_BITS = 3 * 256;
+static uint32_t _buttonsDown[KEY_STATE_BITS / 32];
+
+static int keyStateIndex(uint16_t button) {
+    uint16_t bank = button >> 8;
+    if (bank == 0x00) return button;
+    if (bank == 0x01 || bank == 0xE0) return 256 + (button & 0xFF);
+    if (bank == 0xFF) return 512 + (button & 0xFF);
+    return -1;  // Not tracked
+}
+
+static bool buttonDown(uint16_t button) {
+    int i = keyStateIndex(button);
+    return i >= 0 && (_buttonsDown[i >> 5] & (1UL << (i & 31)));
+}
+
+static void setButtonDown(uint16_t button, bool down) {
+    int i = keyStateIndex(button);
+    if (i < 0) return;
+    if (down) _buttonsDown[i >> 5] |= 1UL << (i & 31);
+    else _buttonsDown[i >> 5] &= ~(1UL << (i & 31));
+}
+
+// Target keyboard layout; LAYOUT_SCANCODE forwards physical keys as they are
+static keyboard_layout::Layout _layout = keyboard_layout::LAYOUT_SCANCODE;
+
+// Keys currently down: what each press went out as and how long it has been
+// held. With the table full a key still works; only its hold statistics are
+// lost and its release falls back to the scancode.
+struct HeldKey {
+    uint16_t button;
+    uint8_t usage;         // 0: nothing left to release (dead key, unmapped)
+    bool stroke;           // Sent through the layout (ble_hid::strokePress)
+    uint8_t strokeMods;
+    bool held;
+    uint16_t repeats;      // DKRP seen while held
+    unsigned long downMs;
+};
+static HeldKey _heldKeys[8];
+static KeyStats _keyStats = { 0, 0, 0, 0 };
+static const uint8_t HID_USAGE_SPACE = 0x2C;
+
+static void queueKey(uint8_t usage, uint16_t modifiers, bool down, bool stroke, uint8_t strokeMods) {
+    input_queue::Event ev;
+    ev.type = input_queue::EVENT_KEY;
+    ev.key.code = usage;
+    ev.key.down = down;
+    ev.key.modifiers = modifiers;
+    ev.key.stroke = stroke;
+    ev.key.strokeMods = strokeMods;
+    queueEvent(ev);
+}
+
+static HeldKey* findHeld(uint16_t button) {
+    for (HeldKey& k : _heldKeys) {
+        if (k.held && k.button == button) return &k;
+    }
+    return nullptr;
 }
 
-// Track currently pressed keys for proper release
-static uint8_t _pressedKey = 0;
+// Remember what a press went out as, by server button
+static void trackHeld(uint16_t button, uint8_t usage, bool stroke, uint8_t strokeMods) {
+    HeldKey* slot = findHeld(button);
+    for (HeldKey& k : _heldKeys) {
+        if (slot) break;
+        if (!k.held) slot = &k;
+    }
+    if (!slot) return;
+    slot->button = button;
+    slot->usage = usage;
+    slot->stroke = stroke;
+    slot->strokeMods = strokeMods;
+    slot->held = true;
+    slot->repeats = 0;
+    slot->downMs = millis();
+}
+
+static void typeThroughLayout(const keyboard_layout::Stroke& stroke, uint16_t modifiers, uint16_t button) {
+    uint8_t mods = keyboard_layout::hidModifiers(stroke.flags);
+    if (stroke.flags & STROKE_DEAD) {
+        // A dead key alone only arms an accent; Space makes it type itself
+        queueKey(stroke.usage, modifiers, true, true, mods);
+        queueKey(stroke.usage, modifiers, false, true, mods);
+        queueKey(HID_USAGE_SPACE, modifiers, true, true, 0);
+        queueKey(HID_USAGE_SPACE, modifiers, false, true, 0);
+        trackHeld(button, 0, true, 0);
+        return;
+    }
+    queueKey(stroke.usage, modifiers, true, true, mods);
+    trackHeld(button, stroke.usage, true, mods);
+}
+
+// DKRP for a key that is down. The target's OS autorepeats a held key by
+// itself, so by default the repeat is dropped instead of costing a report.
+static void onKeyRepeat(uint16_t button, uint16_t modifiers) {
+    HeldKey* k = findHeld(button);
+    if (k && k->repeats < UINT16_MAX) k->repeats++;
+#if KEY_REPEAT_PASSTHROUGH
+    // An identical report would be ignored: release and press again
+    if (k && k->usage) {
+        queueKey(k->usage, modifiers, false, k->stroke, k->strokeMods);
+        queueKey(k->usage, modifiers, true, k->stroke, k->strokeMods);
+    }
+    _keyStats.repeatsForwarded++;
+#else
+    (void)modifiers;
+    _keyStats.repeatsDropped++;
+#endif
+}
+
+static void onKeyUp(uint16_t keyId, uint16_t modifiers, uint16_t button) {
+    if (keyStateIndex(button) >= 0 && !buttonDown(button)) {
+        _keyStats.strayReleases++;
+        Serial.printf("[Key] btn=0x%04X UP without DOWN, ignored\n", button);
+        return;
+    }
+    setButtonDown(button, false);
+    
+    // Release what the press sent, whatever key id the release carries
+    HeldKey* k = findHeld(button);
+    if (k) {
+        k->held = false;
+        uint32_t heldMs = millis() - k->downMs;
+        if (heldMs > _keyStats.longestHoldMs) _keyStats.longestHoldMs = heldMs;
+        if (k->repeats) {
+            Serial.printf("[Key] btn=0x%04X held %lu ms, %u repeats %s\n", button, (unsigned long)heldMs,
+                          k->repeats, KEY_REPEAT_PASSTHROUGH ? "forwarded" : "dropped");
+        }
+        if (k->usage) queueKey(k->usage, modifiers, false, k->stroke, k->strokeMods);
+        return;
+    }
+    
+    uint8_t usage = hid_keymap::usageFor(button);
+    Serial.printf("[Key] id=0x%04X btn=0x%04X -> usage=0x%02X UP\n", keyId, button, usage);
+    if (usage) queueKey(usage, modifiers, false, false, 0);
+}
 
 // Keyboard callback from Synergy protocol
-static void onKeyboard(uint16_t key, uint16_t modifiers, bool down, bool repeat) {
-    uint8_t asciiKey = synergyToAscii(key);
+static void onKeyboard(uint16_t keyId, uint16_t modifiers, uint16_t button, bool down, bool repeat) {
+    if (repeat && buttonDown(button)) {
+        onKeyRepeat(button, modifiers);
+        return;
+    }
+    if (!down) {
+        onKeyUp(keyId, modifiers, button);
+        return;
+    }
+    
+    // DKDN, or a DKRP whose DKDN never arrived
+    setButtonDown(button, true);
+    keyboard_layout::Stroke stroke;
+    if (keyboard_layout::lookup(_layout, keyId, stroke)) {
+        Serial.printf("[Key] id=0x%04X btn=0x%04X -> %s usage=0x%02X DOWN\n", keyId, button,
+                      keyboard_layout::name(_layout), stroke.usage);
+        typeThroughLayout(stroke, modifiers, button);
+        return;
+    }
+    
+    uint8_t usage = hid_keymap::usageFor(button);
     
     // Debug: show what we receive and what we send
-    Serial.printf("[Key] syn=0x%04X -> ascii=0x%02X ('%c') %s\n", 
-                  key, asciiKey, (asciiKey >= 32 && asciiKey < 127) ? asciiKey : '?', 
-                  down ? "DOWN" : "UP");
+    Serial.printf("[Key] id=0x%04X btn=0x%04X -> usage=0x%02X DOWN\n", keyId, button, usage);
     
-    if (asciiKey == 0 && key != 0) {
+    trackHeld(button, usage, false, 0);
+    if (usage) queueKey(usage, modifiers, true, false, 0);
+}
+
+// Clipboard text streamed from the server. We have no way to push it to the
+// target over HID, so only its size is tracked for the log.
+static uint32_t _clipboardBytes = 0;
+
+static void onClipboard(uint8_t id, const uint8_t* data, size_t len, bool final) {
+    (void)data;
+    if (!final) {
+        _clipboardBytes += len;
         return;
     }
+    web_ui::log("Clipboard " + String(id) + " received (" + String(_clipboardBytes) + " bytes text)");
+    _clipboardBytes = 0;
+}
+
+// Release everything the server left held whenever input stops arriving the
+// normal way (screen left, session lost). The HID side counts a forced
+// release when it actually finds keys or buttons down.
+static void releaseHeldInput(const char* why) {
+    uint32_t held = 0;
+    for (uint32_t word : _buttonsDown) held += __builtin_popcount(word);
+    memset(_buttonsDown, 0, sizeof(_buttonsDown));
+    for (HeldKey& k : _heldKeys) k.held = false;
+    if (held) Serial.printf("[Key] %s: releasing %u held keys\n", why, (unsigned)held);
     
-    ble_hid::keyPress(asciiKey, modifiers, down);
+    input_queue::Event ev;
+    ev.type = input_queue::EVENT_RELEASE_ALL;
+    ev.rxMicros = latency::now();
+    _inputQueue.push(ev);  // If refused, drainInput() releases via the release request
 }
 
 // Screen active callback
 static void onScreenActive(bool active) {
     if (active) {
         web_ui::log("Screen activated - receiving input");
-        // Reset mouse position on enter
-        _lastMouseX = 0;
-        _lastMouseY = 0;
+        // Absolute moves continue from where the server entered the screen
+        _lastMouseX = _synergy.cursorX();
+        _lastMouseY = _synergy.cursorY();
     } else {
         web_ui::log("Screen deactivated");
-        // Release all keys/buttons when leaving
-        uint8_t keys[6] = {0};
-        ble_hid::keyboardReport(0, keys);
-        ble_hid::mouseReport(0, 0, 0, 0);
+        releaseHeldInput("screen left");
+    }
+}
+
+void drainInput() {
+    input_queue::Event ev;
+    while (_inputQueue.pop(ev)) {
+        // rx->ble only counts input that came off the socket and reached the
+        // BLE stack: not release-alls, dropped reports or merely accumulated motion
+        bool sent = false;
+        switch (ev.type) {
+            case input_queue::EVENT_MOUSE: {
+                // Coalesced moves can exceed the int8 report range; feed them
+                // through in pieces (ble_hid accumulates between reports)
+                int16_t dx = ev.mouse.dx;
+                int16_t dy = ev.mouse.dy;
+                do {
+                    int8_t sendDx = (dx > 127) ? 127 : ((dx < -127) ? -127 : (int8_t)dx);
+                    int8_t sendDy = (dy > 127) ? 127 : ((dy < -127) ? -127 : (int8_t)dy);
+                    sent |= ble_hid::mouseReport(ev.mouse.buttons, sendDx, sendDy, ev.mouse.wheel);
+                    ev.mouse.wheel = 0;
+                    dx -= sendDx;
+                    dy -= sendDy;
+                } while (dx != 0 || dy != 0);
+                break;
+            }
+            case input_queue::EVENT_KEY:
+                if (ev.key.stroke) {
+                    sent = ble_hid::strokePress(ev.key.code, ev.key.strokeMods,
+                                                synergyToHidMod(ev.key.modifiers), ev.key.down);
+                } else {
+                    sent = ble_hid::keyPress(ev.key.code, synergyToHidMod(ev.key.modifiers), ev.key.down);
+                }
+                break;
+            case input_queue::EVENT_RELEASE_ALL:
+                ble_hid::releaseAll();
+                break;
+        }
+        if (sent) latency::record(latency::STAGE_BLE, latency::now() - ev.rxMicros);
+    }
+    // Something was refused by a full ring: release everything now that it's empty
+    if (_inputQueue.takeReleaseRequest()) {
+        ble_hid::releaseAll();
+    }
+}
+
+#if HID_TASK_ENABLED
+// BLE HID side of the pipeline, pinned next to the NimBLE host so a stalled
+// notification never holds up TCP parsing in loop()
+static void hidTask(void*) {
+    for (;;) {
+        drainInput();
+        ble_hid::poll();
+        vTaskDelay(1);
     }
 }
+#endif
+
+static void loadScreenGeometry() {
+    Preferences prefs;
+    prefs.begin(PREFS_NAMESPACE, true);
+    synergy::ScreenGeometry g;
+    g.x = prefs.getShort(PREF_SCREEN_X, 0);
+    g.y = prefs.getShort(PREF_SCREEN_Y, 0);
+    g.width = prefs.getUShort(PREF_SCREEN_W, SCREEN_DEFAULT_WIDTH);
+    g.height = prefs.getUShort(PREF_SCREEN_H, SCREEN_DEFAULT_HEIGHT);
+    prefs.end();
+    
+    if (!g.width || !g.height || g.width > INT16_MAX || g.height > INT16_MAX) {
+        g.width = SCREEN_DEFAULT_WIDTH;
+        g.height = SCREEN_DEFAULT_HEIGHT;
+    }
+    _synergy.setScreenGeometry(g);
+    Serial.printf("[Deskflow] Screen %ux%u at %d,%d\n", g.width, g.height, g.x, g.y);
+}
+
+static void loadKeyboardLayout() {
+    Preferences prefs;
+    prefs.begin(PREFS_NAMESPACE, true);
+    uint8_t layout = prefs.getUChar(PREF_KEYBOARD_LAYOUT, keyboard_layout::LAYOUT_SCANCODE);
+    prefs.end();
+    
+    _layout = layout < keyboard_layout::LAYOUT_COUNT ? (keyboard_layout::Layout)layout
+                                                     : keyboard_layout::LAYOUT_SCANCODE;
+    Serial.printf("[Deskflow] Keyboard layout: %s\n", keyboard_layout::name(_layout));
+}
 
 void begin() {
     _synergy.setClientName(device_name::get().c_str());
-    _synergy.setScreenSize(1920, 1080);  // Virtual screen size
+    loadScreenGeometry();
+    loadKeyboardLayout();
     _synergy.setMouseCallback(onMouse);
+    _synergy.setRelativeMouseCallback(onMouseRelative);
     _synergy.setKeyboardCallback(onKeyboard);
     _synergy.setScreenActiveCallback(onScreenActive);
+    _synergy.setClipboardCallback(onClipboard);
+#if HID_TASK_ENABLED
+    xTaskCreatePinnedToCore(hidTask, "hid", HID_TASK_STACK, nullptr,
+                            HID_TASK_PRIORITY, nullptr, HID_TASK_CORE);
+#endif
     _initialized = true;
 }
 
-static void ensureRemoteConnected() {
-    if (!_useRemote) return;
-    if (_remoteClient && _remoteClient.connected()) return;
+static String endpointName(const Endpoint& e) {
+    return e.host + ":" + String(e.port);
+}
+
+// Drop whatever the active endpoint has in flight: lookup, connect or session
+static void closeActive(const char* why) {
+    // Keys down when the session died would never see their DKUP
+    if (_sessionUp) releaseHeldInput(why);
+    // Close at once: a dead peer would never answer stop()'s FIN
+    if (_resolving) _dns.cancelLookup();
+    _remoteClient.connectCancel();
+    _synergy.resetState();
+    _activeEndpoint = -1;
+    _resolving = false;
+    _connecting = false;
+    _sessionUp = false;
+    _sessionAccepted = false;
+}
+
+// Back off an endpoint after a failed connect or a lost session: the delay
+// doubles per consecutive failure, with up to 25% jitter so a lab full of
+// clients doesn't reconnect in lockstep when a server comes back.
+static void endpointFailed(int8_t index, const String& why) {
+    Endpoint& e = _endpoints[index];
+    if (e.failures < 16) e.failures++;
+    uint32_t delayMs = DESKFLOW_RETRY_BASE_MS << (e.failures - 1);
+    if (delayMs > DESKFLOW_RETRY_MAX_MS || delayMs < DESKFLOW_RETRY_BASE_MS) delayMs = DESKFLOW_RETRY_MAX_MS;
+    delayMs += (uint32_t)random(delayMs / 4 + 1);
+    e.retryAtMs = millis() + delayMs;
+    // The server may have moved: look the name up again on the next attempt,
+    // keeping the old address only as a fallback if DNS doesn't answer
+    if (!e.addrNumeric) e.addrExpiresMs = millis();
+    
+    Serial.printf("[Deskflow] %s: %s, retry in %lu ms\n", endpointName(e).c_str(), why.c_str(),
+                  (unsigned long)delayMs);
+    web_ui::log(endpointName(e) + ": " + why);
+    
+    if (index == _activeEndpoint) closeActive(why.c_str());
+}
+
+// A session the server had accepted went silent (server asleep, switch
+// rebooted). That is not a reason to back off: reconnect on the next poll.
+// If the server is really gone that connect fails and the backoff moves on
+// to the next server.
+static void sessionTimedOut() {
+    Endpoint& e = _endpoints[_activeEndpoint];
+    e.retryAtMs = millis();
+    if (!e.addrNumeric) e.addrExpiresMs = millis();
     
+    Serial.printf("[Deskflow] %s: keep-alive timed out, reconnecting\n", endpointName(e).c_str());
+    web_ui::log(endpointName(e) + ": keep-alive timed out, reconnecting");
+    closeActive("keep-alive timed out");
+}
+
+static bool addressFresh(const Endpoint& e, unsigned long now) {
+    return e.addrValid && (e.addrNumeric || (long)(now - e.addrExpiresMs) < 0);
+}
+
+static void startConnect(int8_t index) {
+    Endpoint& e = _endpoints[index];
+    _activeEndpoint = index;
+    if (_remoteClient.connectStart(e.addr, e.port)) {
+        _connecting = true;
+        _sessionUp = false;
+        _sessionAccepted = false;
+    } else {
+        endpointFailed(index, "no free socket");
+    }
+}
+
+static void ensureRemoteConnected() {
+    if (!_endpointCount) return;
     unsigned long now = millis();
-    if (now - _lastConnectAttempt < 5000) return; // Retry every 5s
-    _lastConnectAttempt = now;
     
-    if (!_remoteHost.length()) return;
+    if (_activeEndpoint >= 0 && _resolving) {
+        // Non-blocking DNS lookup
+        Endpoint& e = _endpoints[_activeEndpoint];
+        IPAddress ip;
+        uint32_t ttl = 0;
+        int result = _dns.pollLookup(ip, &ttl);
+        if (result == 0) return;
+        _resolving = false;
+        
+        if (result == 1) {
+            if (ttl < DESKFLOW_DNS_MIN_TTL_S) ttl = DESKFLOW_DNS_MIN_TTL_S;
+            if (ttl > DESKFLOW_DNS_MAX_TTL_S) ttl = DESKFLOW_DNS_MAX_TTL_S;
+            e.addr = ip;
+            e.addrValid = true;
+            e.addrExpiresMs = now + ttl * 1000UL;
+            Serial.println("[Deskflow] " + e.host + " is " + ip.toString() + " (TTL " + String(ttl) + " s)");
+        } else if (e.addrValid) {
+            // DNS down or slow: the last known address is better than nothing
+            Serial.println("[Deskflow] DNS lookup failed, using cached " + e.addr.toString());
+        } else {
+            endpointFailed(_activeEndpoint, "DNS lookup failed");
+            return;
+        }
+        startConnect(_activeEndpoint);
+        return;
+    }
+    
+    if (_activeEndpoint >= 0 && _connecting) {
+        // Non-blocking TCP connect; loop() keeps running while the SYN is out
+        int result = _remoteClient.connectPoll();
+        if (result == 0) return;
+        if (result < 0) {
+            endpointFailed(_activeEndpoint, "connection failed");
+        } else {
+            _connecting = false;
+            _connectedAtMs = millis();
+            Serial.println("[Deskflow] TCP connected, waiting for handshake...");
+            web_ui::log("TCP connected");
+            return;
+        }
+    }
+    
+    if (_activeEndpoint >= 0) {
+        if (_remoteClient.connected()) {
+            // TCP up but no server hello: not a live Deskflow server
+            if (!_sessionUp && now - _connectedAtMs > DESKFLOW_HANDSHAKE_TIMEOUT_MS) {
+                endpointFailed(_activeEndpoint, "no handshake");
+            }
+            return;
+        }
+        endpointFailed(_activeEndpoint, _sessionUp ? "connection closed" : "connection refused");
+    }
+    
+    // Highest-priority endpoint that is out of backoff; a failed server is
+    // skipped straight away in favour of the next one
+    int8_t next = -1;
+    for (uint8_t i = 0; i < _endpointCount; i++) {
+        if ((long)(now - _endpoints[i].retryAtMs) >= 0) {
+            next = i;
+            break;
+        }
+    }
+    if (next < 0) return;
+    Endpoint& e = _endpoints[next];
     
     // Reset synergy state before new connection attempt
     _synergy.resetState();
     
-    Serial.println("[Deskflow] Connecting to " + _remoteHost + ":" + String(_remotePort));
-    web_ui::log("Connecting to " + _remoteHost + ":" + String(_remotePort));
+    Serial.println("[Deskflow] Connecting to " + endpointName(e));
+    web_ui::log("Connecting to " + endpointName(e));
     
-    _remoteClient.stop();
-    if (_remoteClient.connect(_remoteHost.c_str(), _remotePort)) {
-        Serial.println("[Deskflow] TCP connected, waiting for handshake...");
-        web_ui::log("TCP connected");
+    if (addressFresh(e, now)) {
+        startConnect(next);
+        return;
+    }
+    
+    // Resolve (or refresh an expired address) without blocking loop()
+    _dns.begin(Ethernet.dnsServerIP());
+    if (_dns.beginLookup(e.host.c_str(), DESKFLOW_DNS_TIMEOUT_MS) == 1) {
+        _activeEndpoint = next;
+        _resolving = true;
+    } else if (e.addrValid) {
+        startConnect(next);
     } else {
-        Serial.println("[Deskflow] Connection failed");
-        web_ui::log("Connection failed");
+        endpointFailed(next, "DNS unavailable");
     }
 }
 
-void setRemoteEndpoint(const String& url) {
-    String u = url;
+// One "[tcp://]host[:port]" entry
+static bool parseEndpoint(String u, Endpoint& e) {
     u.trim();
-    
-    if (!u.length()) {
-        if (_useRemote) {
-            _useRemote = false;
-            _remoteClient.stop();
-            Serial.println("[Deskflow] Remote endpoint cleared");
-        }
-        return;
-    }
+    if (!u.length()) return false;
     
     // Strip protocol prefix
     if (u.startsWith("tcp://")) u.remove(0, 6);
@@ -297,28 +622,160 @@ void setRemoteEndpoint(const String& url) {
     else if (u.startsWith("deskflow://")) u.remove(0, 11);
     
     // Parse host:port
-    String host = u;
-    uint16_t port = 24800;
+    e.host = u;
+    e.port = DESKFLOW_TCP_PORT;
     int colon = u.lastIndexOf(':');
     if (colon > 0 && colon < (int)u.length() - 1) {
-        host = u.substring(0, colon);
-        port = (uint16_t)u.substring(colon + 1).toInt();
-        if (!port) port = 24800;
+        e.host = u.substring(0, colon);
+        e.port = (uint16_t)u.substring(colon + 1).toInt();
+        if (!e.port) e.port = DESKFLOW_TCP_PORT;
+    }
+    e.failures = 0;
+    e.retryAtMs = millis();
+    DNSClient literal;
+    e.addrValid = e.addrNumeric = literal.inet_aton(e.host.c_str(), e.addr) == 1;
+    e.addrExpiresMs = 0;
+    return e.host.length() > 0;
+}
+
+void setRemoteEndpoint(const String& url) {
+    // Called every loop with the WebUI value; only reparse when it changes
+    if (url == _endpointSpec) return;
+    _endpointSpec = url;
+    
+    if (_resolving) _dns.cancelLookup();
+    if (_sessionUp) releaseHeldInput("server changed");
+    _remoteClient.stop();
+    _synergy.resetState();
+    _activeEndpoint = -1;
+    _resolving = false;
+    _connecting = false;
+    _sessionUp = false;
+    _sessionAccepted = false;
+    _endpointCount = 0;
+    
+    int pos = 0;
+    while (pos <= (int)url.length() && _endpointCount < DESKFLOW_MAX_ENDPOINTS) {
+        int comma = url.indexOf(',', pos);
+        if (comma < 0) comma = url.length();
+        if (parseEndpoint(url.substring(pos, comma), _endpoints[_endpointCount])) {
+            _endpointCount++;
+        }
+        pos = comma + 1;
     }
     
-    // Check if changed
-    if (host == _remoteHost && port == _remotePort && _useRemote) {
+    if (!_endpointCount) {
+        Serial.println("[Deskflow] Remote endpoint cleared");
         return;
     }
+    Serial.println("[Deskflow] Remote endpoints: " + endpointSummary());
+    web_ui::log("Endpoints: " + endpointSummary());
+}
+
+String endpointSummary() {
+    String out;
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < _endpointCount; i++) {
+        const Endpoint& e = _endpoints[i];
+        if (out.length()) out += ", ";
+        out += endpointName(e);
+        if (i == _activeEndpoint) {
+            out += _sessionUp ? " (connected)" : _resolving ? " (resolving)" :
+                   _connecting ? " (connecting)" : " (handshake)";
+        } else if (e.failures) {
+            long wait = (long)(e.retryAtMs - now);
+            out += " (" + String(e.failures) + " failures";
+            if (wait > 0) out += ", retry in " + String((wait + 999) / 1000) + " s";
+            out += ")";
+        }
+    }
+    return out;
+}
+
+synergy::ScreenGeometry screenGeometry() {
+    return _synergy.screenGeometry();
+}
+
+bool setScreenGeometry(const synergy::ScreenGeometry& geometry) {
+    // Synergy carries sizes as 16-bit signed values on the wire
+    if (!geometry.width || !geometry.height ||
+        geometry.width > INT16_MAX || geometry.height > INT16_MAX) {
+        return false;
+    }
     
-    _remoteHost = host;
-    _remotePort = port;
-    _useRemote = true;
-    _remoteClient.stop();
-    _lastConnectAttempt = 0;
+    const synergy::ScreenGeometry& current = _synergy.screenGeometry();
+    if (memcmp(&geometry, &current, sizeof(geometry)) == 0) return true;
     
-    Serial.println("[Deskflow] Remote endpoint: " + _remoteHost + ":" + String(_remotePort));
-    web_ui::log("Endpoint: " + _remoteHost + ":" + String(_remotePort));
+    Preferences prefs;
+    prefs.begin(PREFS_NAMESPACE, false);
+    prefs.putShort(PREF_SCREEN_X, geometry.x);
+    prefs.putShort(PREF_SCREEN_Y, geometry.y);
+    prefs.putUShort(PREF_SCREEN_W, geometry.width);
+    prefs.putUShort(PREF_SCREEN_H, geometry.height);
+    prefs.end();
+    
+    _synergy.setScreenGeometry(geometry);
+    web_ui::log("Screen set to " + String(geometry.width) + "x" + String(geometry.height) +
+                " at " + String(geometry.x) + "," + String(geometry.y));
+    return true;
+}
+
+keyboard_layout::Layout keyboardLayout() {
+    return _layout;
+}
+
+void setKeyboardLayout(keyboard_layout::Layout layout) {
+    if (layout >= keyboard_layout::LAYOUT_COUNT || layout == _layout) return;
+    
+    Preferences prefs;
+    prefs.begin(PREFS_NAMESPACE, false);
+    prefs.putUChar(PREF_KEYBOARD_LAYOUT, layout);
+    prefs.end();
+    
+    _layout = layout;
+    web_ui::log(String("Keyboard layout set to ") + keyboard_layout::name(layout));
+}
+
+String sessionSummary() {
+    if (!_synergy.isConnected()) return String("not connected");
+    String s = String(_synergy.serverProtocol()) + " " + String(SYNERGY_PROTOCOL_MAJOR) + "." +
+               String(_synergy.protocolMinor()) + " (" +
+               synergy::SynergyClient::featureNames(_synergy.features()) + ")";
+    if (_synergy.serverLanguages()[0]) s += ", languages " + String(_synergy.serverLanguages());
+    const synergy::ServerOptions& opt = _synergy.serverOptions();
+    if (opt.hasHeartbeat) s += ", heartbeat " + (opt.heartbeatMs ? String(opt.heartbeatMs) + " ms" : String("off"));
+    if (opt.relativeMouseMoves) s += ", relative mouse";
+    if (!opt.clipboardSharing) s += ", clipboard sharing off";
+    return s;
+}
+
+const synergy::Stats& protocolStats() {
+    return _synergy.stats();
+}
+
+String messageReport() {
+    String out = "msg      count      bytes   age_ms  handler_us  avg_us\n";
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < synergy::MSG_COUNT; i++) {
+        synergy::MessageId id = (synergy::MessageId)i;
+        const synergy::MessageCounter& c = _synergy.messageCounter(id);
+        if (!c.count) continue;
+        char line[80];
+        snprintf(line, sizeof(line), "%-4s %9u %10u %8u %11u %7u\n",
+                 synergy::SynergyClient::messageName(id), (unsigned)c.count, (unsigned)c.bytes,
+                 (unsigned)(now - c.lastSeenMs), (unsigned)c.handlerMicros,
+                 (unsigned)(c.handlerMicros / c.count));
+        out += line;
+    }
+    return out;
+}
+
+const KeyStats& keyStats() {
+    return _keyStats;
+}
+
+const input_queue::Stats& inputQueueStats() {
+    return _inputQueue.stats();
 }
 
 void poll() {
@@ -326,9 +783,33 @@ void poll() {
     
     ensureRemoteConnected();
     
-    if (_useRemote && _remoteClient.connected()) {
+    if (_activeEndpoint >= 0 && !_resolving && !_connecting && _remoteClient.connected()) {
         _synergy.update(_remoteClient);
+        if (!_sessionUp && _synergy.isConnected()) {
+            _sessionUp = true;
+        }
+        // Only a session the server accepted clears the backoff: a hello
+        // answered with EUNK (misnamed screen) or EBSY keeps backing off
+        if (_sessionUp && _synergy.isAccepted()) {
+            _endpoints[_activeEndpoint].failures = 0;
+            _sessionAccepted = true;
+        }
+        synergy::DropReason drop = _synergy.takeDropReason();
+        if (drop == synergy::DROP_KEEPALIVE && _sessionAccepted) {
+            // Half-open connection: the W5500 would hold it open for minutes
+            sessionTimedOut();
+        } else if (drop != synergy::DROP_NONE) {
+            // A corrupt stream can't be resynchronized, and a server that
+            // never accepted us and then went quiet is treated the same
+            endpointFailed(_activeEndpoint, drop == synergy::DROP_KEEPALIVE
+                           ? "keep-alive timed out" : "protocol error");
+        }
     }
+    _inputQueue.flushPending();
+    
+#if !HID_TASK_ENABLED
+    drainInput();
+#endif
 }
 
 } // namespace deskflow
@@ -0,0 +1,49 @@
+/**
+ * Synergy key button to USB HID usage translation — implementation
+ */
+
+#include "../include/hid_keymap.h"
+
+namespace hid_keymap {
+
+// Keypad and extended keys keep their own usages instead of folding onto the
+// main block (KP7 is not the top-row 7, KP Enter is not Return)
+static_assert(usageForScancode(0x47) == 0x5F, "KP7 must map to Keypad 7");
+static_assert(usageForScancode(0x11C) == 0x58, "KP Enter must map to Keypad Enter");
+static_assert(usageForScancode(0xE048) == 0x52, "E0 48 must map to Up Arrow");
+static_assert(modifierBit(0xE5) == 0x20, "Right Shift is modifier bit 5");
+
+struct KeysymUsage {
+    uint16_t keysym;
+    uint8_t usage;
+};
+
+// X11 keysyms (0xFFxx) some servers send in place of a scancode
+static constexpr KeysymUsage KEYSYM_USAGE[] = {
+    { 0xFF08, 0x2A }, { 0xFF09, 0x2B }, { 0xFF0D, 0x28 }, { 0xFF13, 0x48 },  // BackSpace, Tab, Return, Pause
+    { 0xFF14, 0x47 }, { 0xFF1B, 0x29 }, { 0xFF50, 0x4A }, { 0xFF51, 0x50 },  // Scroll_Lock, Escape, Home, Left
+    { 0xFF52, 0x52 }, { 0xFF53, 0x4F }, { 0xFF54, 0x51 }, { 0xFF55, 0x4B },  // Up, Right, Down, Prior
+    { 0xFF56, 0x4E }, { 0xFF57, 0x4D }, { 0xFF61, 0x46 }, { 0xFF63, 0x49 },  // Next, End, Print, Insert
+    { 0xFF67, 0x65 }, { 0xFF7F, 0x53 }, { 0xFF8D, 0x58 }, { 0xFFAA, 0x55 },  // Menu, Num_Lock, KP_Enter, KP_Multiply
+    { 0xFFAB, 0x57 }, { 0xFFAD, 0x56 }, { 0xFFAE, 0x63 }, { 0xFFAF, 0x54 },  // KP_Add, KP_Subtract, KP_Decimal, KP_Divide
+    { 0xFFB0, 0x62 }, { 0xFFB1, 0x59 }, { 0xFFB2, 0x5A }, { 0xFFB3, 0x5B },  // KP_0-KP_3
+    { 0xFFB4, 0x5C }, { 0xFFB5, 0x5D }, { 0xFFB6, 0x5E }, { 0xFFB7, 0x5F },  // KP_4-KP_7
+    { 0xFFB8, 0x60 }, { 0xFFB9, 0x61 }, { 0xFFBE, 0x3A }, { 0xFFBF, 0x3B },  // KP_8, KP_9, F1, F2
+    { 0xFFC0, 0x3C }, { 0xFFC1, 0x3D }, { 0xFFC2, 0x3E }, { 0xFFC3, 0x3F },  // F3-F6
+    { 0xFFC4, 0x40 }, { 0xFFC5, 0x41 }, { 0xFFC6, 0x42 }, { 0xFFC7, 0x43 },  // F7-F10
+    { 0xFFC8, 0x44 }, { 0xFFC9, 0x45 }, { 0xFFE1, 0xE1 }, { 0xFFE2, 0xE5 },  // F11, F12, Shift_L, Shift_R
+    { 0xFFE3, 0xE0 }, { 0xFFE4, 0xE4 }, { 0xFFE5, 0x39 }, { 0xFFE9, 0xE2 },  // Control_L, Control_R, Caps_Lock, Alt_L
+    { 0xFFEA, 0xE6 }, { 0xFFEB, 0xE3 }, { 0xFFEC, 0xE7 }, { 0xFFFF, 0x4C },  // Alt_R, Super_L, Super_R, Delete
+};
+
+uint8_t usageFor(uint16_t button) {
+    uint8_t usage = usageForScancode(button);
+    if (usage || (button & 0xFF00) != 0xFF00) return usage;
+
+    for (const KeysymUsage& k : KEYSYM_USAGE) {
+        if (k.keysym == button) return k.usage;
+    }
+    return 0;
+}
+
+} // namespace hid_keymap
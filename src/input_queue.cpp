@@ -0,0 +1,116 @@
+/**
+ * Input event queue — implementation
+ */
+
+#include "../include/input_queue.h"
+#include <string.h>
+
+namespace input_queue {
+
+static_assert((INPUT_QUEUE_CAPACITY & (INPUT_QUEUE_CAPACITY - 1)) == 0,
+              "INPUT_QUEUE_CAPACITY must be a power of two");
+static_assert(sizeof(Event) <= 12, "Event should stay compact");
+static_assert(INPUT_QUEUE_RESERVED > 1 && INPUT_QUEUE_RESERVED < INPUT_QUEUE_CAPACITY,
+              "INPUT_QUEUE_RESERVED must leave room for motion and a flushed pending move");
+
+static const uint32_t QUEUE_MASK = INPUT_QUEUE_CAPACITY - 1;
+static const uint32_t MOTION_LIMIT = INPUT_QUEUE_CAPACITY - INPUT_QUEUE_RESERVED;
+
+SpscQueue::SpscQueue()
+    : _head(0)
+    , _tail(0)
+    , _releaseRequest(false)
+    , _hasPending(false)
+    , _lastButtons(0)
+{
+    memset(&_pending, 0, sizeof(_pending));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+uint32_t SpscQueue::size() const {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+}
+
+bool SpscQueue::tryPush(const Event& ev, uint32_t limit) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    uint32_t tail = _tail.load(std::memory_order_acquire);
+    uint32_t depth = head - tail;
+    if (depth >= limit) return false;
+
+    _slots[head & QUEUE_MASK] = ev;
+    _head.store(head + 1, std::memory_order_release);
+
+    if (depth + 1 > _stats.highWatermark) _stats.highWatermark = depth + 1;
+    return true;
+}
+
+static int16_t addClamped(int16_t a, int16_t b) {
+    int32_t sum = (int32_t)a + b;
+    if (sum > INT16_MAX) return INT16_MAX;
+    if (sum < INT16_MIN) return INT16_MIN;
+    return (int16_t)sum;
+}
+
+bool SpscQueue::flushPending() {
+    if (!_hasPending) return true;
+    if (!tryPush(_pending, MOTION_LIMIT)) return false;
+    _hasPending = false;
+    return true;
+}
+
+bool SpscQueue::push(const Event& ev) {
+    if (ev.type == EVENT_MOUSE && ev.mouse.buttons == _lastButtons) {
+        // Motion: batch it rather than eat into the reserve
+        if (flushPending() && tryPush(ev, MOTION_LIMIT)) {
+            _stats.pushed++;
+            return true;
+        }
+        if (!_hasPending) {
+            _pending = ev;
+            _hasPending = true;
+        } else {
+            _pending.mouse.dx = addClamped(_pending.mouse.dx, ev.mouse.dx);
+            _pending.mouse.dy = addClamped(_pending.mouse.dy, ev.mouse.dy);
+            int16_t wheel = (int16_t)_pending.mouse.wheel + ev.mouse.wheel;
+            _pending.mouse.wheel = (int8_t)(wheel > 127 ? 127 : (wheel < -127 ? -127 : wheel));
+            _stats.coalesced++;
+        }
+        _stats.pushed++;
+        return true;
+    }
+
+    // Key, button change or release-all: the merged move goes out first, and
+    // both may use the reserve
+    if (_hasPending) {
+        if (!tryPush(_pending, INPUT_QUEUE_CAPACITY)) {
+            _stats.overflows++;
+            _releaseRequest.store(true, std::memory_order_release);
+            return false;
+        }
+        _hasPending = false;
+    }
+    if (!tryPush(ev, INPUT_QUEUE_CAPACITY)) {
+        _stats.overflows++;
+        _releaseRequest.store(true, std::memory_order_release);
+        return false;
+    }
+    if (ev.type == EVENT_MOUSE) _lastButtons = ev.mouse.buttons;
+    _stats.pushed++;
+    return true;
+}
+
+bool SpscQueue::pop(Event& ev) {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    uint32_t head = _head.load(std::memory_order_acquire);
+    if (tail == head) return false;
+
+    ev = _slots[tail & QUEUE_MASK];
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool SpscQueue::takeReleaseRequest() {
+    return _releaseRequest.exchange(false, std::memory_order_acquire);
+}
+
+} // namespace input_queue
@@ -0,0 +1,187 @@
+/**
+ * Target keyboard layouts — implementation
+ * One dense table per layout for printable ASCII (two bytes per character, in
+ * flash), plus a short sorted list of the layout's Latin-1 and euro keys.
+ */
+
+#include "../include/keyboard_layout.h"
+
+namespace keyboard_layout {
+
+static const uint16_t ASCII_FIRST = 0x20;
+static const uint16_t ASCII_COUNT = 0x7F - ASCII_FIRST;
+
+struct Extra {
+    uint16_t keyId;
+    Stroke stroke;
+};
+
+#define K(u)  { u, 0 }
+#define S(u)  { u, STROKE_SHIFT }
+#define G(u)  { u, STROKE_ALTGR }
+#define D(u)  { u, STROKE_DEAD }
+#define SD(u) { u, STROKE_SHIFT | STROKE_DEAD }
+#define GD(u) { u, STROKE_ALTGR | STROKE_DEAD }
+
+static const Stroke US_ASCII[ASCII_COUNT] = {
+    K(0x2C), S(0x1E), S(0x34), S(0x20), S(0x21), S(0x22), S(0x24), K(0x34), //   ! " # $ % & '
+    S(0x26), S(0x27), S(0x25), S(0x2E), K(0x36), K(0x2D), K(0x37), K(0x38), // ( ) * + , - . /
+    K(0x27), K(0x1E), K(0x1F), K(0x20), K(0x21), K(0x22), K(0x23), K(0x24), // 0 1 2 3 4 5 6 7
+    K(0x25), K(0x26), S(0x33), K(0x33), S(0x36), K(0x2E), S(0x37), S(0x38), // 8 9 : ; < = > ?
+    S(0x1F), S(0x04), S(0x05), S(0x06), S(0x07), S(0x08), S(0x09), S(0x0A), // @ A B C D E F G
+    S(0x0B), S(0x0C), S(0x0D), S(0x0E), S(0x0F), S(0x10), S(0x11), S(0x12), // H I J K L M N O
+    S(0x13), S(0x14), S(0x15), S(0x16), S(0x17), S(0x18), S(0x19), S(0x1A), // P Q R S T U V W
+    S(0x1B), S(0x1C), S(0x1D), K(0x2F), K(0x31), K(0x30), S(0x23), S(0x2D), // X Y Z [ \ ] ^ _
+    K(0x35), K(0x04), K(0x05), K(0x06), K(0x07), K(0x08), K(0x09), K(0x0A), // ` a b c d e f g
+    K(0x0B), K(0x0C), K(0x0D), K(0x0E), K(0x0F), K(0x10), K(0x11), K(0x12), // h i j k l m n o
+    K(0x13), K(0x14), K(0x15), K(0x16), K(0x17), K(0x18), K(0x19), K(0x1A), // p q r s t u v w
+    K(0x1B), K(0x1C), K(0x1D), S(0x2F), S(0x31), S(0x30), S(0x35),     // x y z { | } ~
+};
+
+static const Stroke UK_ASCII[ASCII_COUNT] = {
+    K(0x2C), S(0x1E), S(0x1F), K(0x32), S(0x21), S(0x22), S(0x24), K(0x34), //   ! " # $ % & '
+    S(0x26), S(0x27), S(0x25), S(0x2E), K(0x36), K(0x2D), K(0x37), K(0x38), // ( ) * + , - . /
+    K(0x27), K(0x1E), K(0x1F), K(0x20), K(0x21), K(0x22), K(0x23), K(0x24), // 0 1 2 3 4 5 6 7
+    K(0x25), K(0x26), S(0x33), K(0x33), S(0x36), K(0x2E), S(0x37), S(0x38), // 8 9 : ; < = > ?
+    S(0x34), S(0x04), S(0x05), S(0x06), S(0x07), S(0x08), S(0x09), S(0x0A), // @ A B C D E F G
+    S(0x0B), S(0x0C), S(0x0D), S(0x0E), S(0x0F), S(0x10), S(0x11), S(0x12), // H I J K L M N O
+    S(0x13), S(0x14), S(0x15), S(0x16), S(0x17), S(0x18), S(0x19), S(0x1A), // P Q R S T U V W
+    S(0x1B), S(0x1C), S(0x1D), K(0x2F), K(0x64), K(0x30), S(0x23), S(0x2D), // X Y Z [ \ ] ^ _
+    K(0x35), K(0x04), K(0x05), K(0x06), K(0x07), K(0x08), K(0x09), K(0x0A), // ` a b c d e f g
+    K(0x0B), K(0x0C), K(0x0D), K(0x0E), K(0x0F), K(0x10), K(0x11), K(0x12), // h i j k l m n o
+    K(0x13), K(0x14), K(0x15), K(0x16), K(0x17), K(0x18), K(0x19), K(0x1A), // p q r s t u v w
+    K(0x1B), K(0x1C), K(0x1D), S(0x2F), S(0x64), S(0x30), S(0x32),     // x y z { | } ~
+};
+
+static const Stroke DE_ASCII[ASCII_COUNT] = {
+    K(0x2C), S(0x1E), S(0x1F), K(0x32), S(0x21), S(0x22), S(0x23), S(0x32), //   ! " # $ % & '
+    S(0x25), S(0x26), S(0x30), K(0x30), K(0x36), K(0x38), K(0x37), S(0x24), // ( ) * + , - . /
+    K(0x27), K(0x1E), K(0x1F), K(0x20), K(0x21), K(0x22), K(0x23), K(0x24), // 0 1 2 3 4 5 6 7
+    K(0x25), K(0x26), S(0x37), S(0x36), K(0x64), S(0x27), S(0x64), S(0x2D), // 8 9 : ; < = > ?
+    G(0x14), S(0x04), S(0x05), S(0x06), S(0x07), S(0x08), S(0x09), S(0x0A), // @ A B C D E F G
+    S(0x0B), S(0x0C), S(0x0D), S(0x0E), S(0x0F), S(0x10), S(0x11), S(0x12), // H I J K L M N O
+    S(0x13), S(0x14), S(0x15), S(0x16), S(0x17), S(0x18), S(0x19), S(0x1A), // P Q R S T U V W
+    S(0x1B), S(0x1D), S(0x1C), G(0x25), G(0x2D), G(0x26), D(0x35), S(0x38), // X Y Z [ \ ] ^ _
+    SD(0x2E), K(0x04), K(0x05), K(0x06), K(0x07), K(0x08), K(0x09), K(0x0A), // ` a b c d e f g
+    K(0x0B), K(0x0C), K(0x0D), K(0x0E), K(0x0F), K(0x10), K(0x11), K(0x12), // h i j k l m n o
+    K(0x13), K(0x14), K(0x15), K(0x16), K(0x17), K(0x18), K(0x19), K(0x1A), // p q r s t u v w
+    K(0x1B), K(0x1D), K(0x1C), G(0x24), G(0x64), G(0x27), G(0x30),     // x y z { | } ~
+};
+
+static const Stroke FR_ASCII[ASCII_COUNT] = {
+    K(0x2C), K(0x38), K(0x20), G(0x20), K(0x30), S(0x34), K(0x1E), K(0x21), //   ! " # $ % & '
+    K(0x22), K(0x2D), K(0x32), S(0x2E), K(0x10), K(0x23), S(0x36), S(0x37), // ( ) * + , - . /
+    S(0x27), S(0x1E), S(0x1F), S(0x20), S(0x21), S(0x22), S(0x23), S(0x24), // 0 1 2 3 4 5 6 7
+    S(0x25), S(0x26), K(0x37), K(0x36), K(0x64), K(0x2E), S(0x64), S(0x10), // 8 9 : ; < = > ?
+    G(0x27), S(0x14), S(0x05), S(0x06), S(0x07), S(0x08), S(0x09), S(0x0A), // @ A B C D E F G
+    S(0x0B), S(0x0C), S(0x0D), S(0x0E), S(0x0F), S(0x33), S(0x11), S(0x12), // H I J K L M N O
+    S(0x13), S(0x04), S(0x15), S(0x16), S(0x17), S(0x18), S(0x19), S(0x1D), // P Q R S T U V W
+    S(0x1B), S(0x1C), S(0x1A), G(0x22), G(0x25), G(0x2D), G(0x26), K(0x25), // X Y Z [ \ ] ^ _
+    GD(0x24), K(0x14), K(0x05), K(0x06), K(0x07), K(0x08), K(0x09), K(0x0A), // ` a b c d e f g
+    K(0x0B), K(0x0C), K(0x0D), K(0x0E), K(0x0F), K(0x33), K(0x11), K(0x12), // h i j k l m n o
+    K(0x13), K(0x04), K(0x15), K(0x16), K(0x17), K(0x18), K(0x19), K(0x1D), // p q r s t u v w
+    K(0x1B), K(0x1C), K(0x1A), G(0x21), G(0x23), G(0x2E), GD(0x1F),    // x y z { | } ~
+};
+
+static const Stroke NORDIC_ASCII[ASCII_COUNT] = {
+    K(0x2C), S(0x1E), S(0x1F), S(0x20), G(0x21), S(0x22), S(0x23), K(0x32), //   ! " # $ % & '
+    S(0x25), S(0x26), S(0x32), K(0x2D), K(0x36), K(0x38), K(0x37), S(0x24), // ( ) * + , - . /
+    K(0x27), K(0x1E), K(0x1F), K(0x20), K(0x21), K(0x22), K(0x23), K(0x24), // 0 1 2 3 4 5 6 7
+    K(0x25), K(0x26), S(0x37), S(0x36), K(0x64), S(0x27), S(0x64), S(0x2D), // 8 9 : ; < = > ?
+    G(0x1F), S(0x04), S(0x05), S(0x06), S(0x07), S(0x08), S(0x09), S(0x0A), // @ A B C D E F G
+    S(0x0B), S(0x0C), S(0x0D), S(0x0E), S(0x0F), S(0x10), S(0x11), S(0x12), // H I J K L M N O
+    S(0x13), S(0x14), S(0x15), S(0x16), S(0x17), S(0x18), S(0x19), S(0x1A), // P Q R S T U V W
+    S(0x1B), S(0x1C), S(0x1D), G(0x25), G(0x2D), G(0x26), SD(0x30), S(0x38), // X Y Z [ \ ] ^ _
+    SD(0x2E), K(0x04), K(0x05), K(0x06), K(0x07), K(0x08), K(0x09), K(0x0A), // ` a b c d e f g
+    K(0x0B), K(0x0C), K(0x0D), K(0x0E), K(0x0F), K(0x10), K(0x11), K(0x12), // h i j k l m n o
+    K(0x13), K(0x14), K(0x15), K(0x16), K(0x17), K(0x18), K(0x19), K(0x1A), // p q r s t u v w
+    K(0x1B), K(0x1C), K(0x1D), G(0x24), G(0x64), G(0x27), GD(0x30),    // x y z { | } ~
+};
+
+static const Extra UK_EXTRA[] = {
+    { 0x00A3, S(0x20) }, { 0x00A6, G(0x35) }, { 0x00AC, S(0x35) }, { 0x20AC, G(0x21) },  // £ ¦ ¬ €
+};
+
+static const Extra DE_EXTRA[] = {
+    { 0x00A7, S(0x20) }, { 0x00B0, S(0x35) }, { 0x00B2, G(0x1F) }, { 0x00B3, G(0x20) },  // § ° ² ³
+    { 0x00B4, D(0x2E) }, { 0x00B5, G(0x10) }, { 0x00C4, S(0x34) }, { 0x00D6, S(0x33) },  // ´ µ Ä Ö
+    { 0x00DC, S(0x2F) }, { 0x00DF, K(0x2D) }, { 0x00E4, K(0x34) }, { 0x00F6, K(0x33) },  // Ü ß ä ö
+    { 0x00FC, K(0x2F) }, { 0x20AC, G(0x08) },  // ü €
+};
+
+static const Extra FR_EXTRA[] = {
+    { 0x00A3, S(0x30) }, { 0x00A4, G(0x30) }, { 0x00A7, S(0x38) }, { 0x00A8, SD(0x2F) },  // £ ¤ § ¨
+    { 0x00B0, S(0x2D) }, { 0x00B2, K(0x35) }, { 0x00B5, S(0x32) }, { 0x00E0, K(0x27) },  // ° ² µ à
+    { 0x00E7, K(0x26) }, { 0x00E8, K(0x24) }, { 0x00E9, K(0x1F) }, { 0x00F9, K(0x34) },  // ç è é ù
+    { 0x20AC, G(0x08) },  // €
+};
+
+static const Extra NORDIC_EXTRA[] = {
+    { 0x00A3, G(0x20) }, { 0x00A4, S(0x21) }, { 0x00A7, K(0x35) }, { 0x00A8, D(0x30) },  // £ ¤ § ¨
+    { 0x00B4, D(0x2E) }, { 0x00B5, G(0x10) }, { 0x00BD, S(0x35) }, { 0x00C4, S(0x34) },  // ´ µ ½ Ä
+    { 0x00C5, S(0x2F) }, { 0x00D6, S(0x33) }, { 0x00E4, K(0x34) }, { 0x00E5, K(0x2F) },  // Å Ö ä å
+    { 0x00F6, K(0x33) }, { 0x20AC, G(0x22) },  // ö €
+};
+
+#undef K
+#undef S
+#undef G
+#undef D
+#undef SD
+#undef GD
+
+struct LayoutTables {
+    const char* name;
+    const Stroke* ascii;
+    const Extra* extra;
+    uint8_t extraCount;
+};
+
+static const LayoutTables LAYOUTS[LAYOUT_COUNT] = {
+    { "scancode", nullptr,      nullptr,      0 },
+    { "us",       US_ASCII,     nullptr,      0 },
+    { "uk",       UK_ASCII,     UK_EXTRA,     sizeof(UK_EXTRA) / sizeof(UK_EXTRA[0]) },
+    { "de",       DE_ASCII,     DE_EXTRA,     sizeof(DE_EXTRA) / sizeof(DE_EXTRA[0]) },
+    { "fr",       FR_ASCII,     FR_EXTRA,     sizeof(FR_EXTRA) / sizeof(FR_EXTRA[0]) },
+    { "nordic",   NORDIC_ASCII, NORDIC_EXTRA, sizeof(NORDIC_EXTRA) / sizeof(NORDIC_EXTRA[0]) },
+};
+
+const char* name(Layout layout) {
+    return layout < LAYOUT_COUNT ? LAYOUTS[layout].name : "?";
+}
+
+bool fromName(const String& name, Layout& out) {
+    for (uint8_t i = 0; i < LAYOUT_COUNT; i++) {
+        if (name.equalsIgnoreCase(LAYOUTS[i].name)) {
+            out = (Layout)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool lookup(Layout layout, uint16_t keyId, Stroke& out) {
+    if (layout >= LAYOUT_COUNT || !LAYOUTS[layout].ascii) return false;
+    const LayoutTables& t = LAYOUTS[layout];
+    
+    if (keyId >= ASCII_FIRST && keyId < ASCII_FIRST + ASCII_COUNT) {
+        out = t.ascii[keyId - ASCII_FIRST];
+        return out.usage != 0;
+    }
+    for (uint8_t i = 0; i < t.extraCount; i++) {
+        if (t.extra[i].keyId == keyId) {
+            out = t.extra[i].stroke;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t hidModifiers(uint8_t flags) {
+    uint8_t mods = 0;
+    if (flags & STROKE_SHIFT) mods |= 0x02;  // Left Shift
+    if (flags & STROKE_ALTGR) mods |= 0x40;  // Right Alt
+    return mods;
+}
+
+} // namespace keyboard_layout
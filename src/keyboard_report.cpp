@@ -0,0 +1,158 @@
+/**
+ * HID keyboard report builder — implementation
+ */
+
+#include "../include/keyboard_report.h"
+#include "../include/hid_keymap.h"
+#include <string.h>
+
+static const uint8_t STROKE_MOD_MASK = 0x62;  // Left/Right Shift, Right Alt
+
+static_assert(KEYBOARD_NKRO_SIZE >= KEYBOARD_REPORT_SIZE, "_sent holds either format");
+static_assert(KEYBOARD_NKRO_USAGES % 8 == 0, "NKRO bitmap is whole bytes");
+
+KeyboardReport::KeyboardReport()
+    : _format(FORMAT_BOOT)
+    , _heldMods(0)
+    , _strokeUsage(0)
+    , _strokeMods(0)
+    , _overflows(0)
+{
+    memset(_report, 0, sizeof(_report));
+    memset(_nkro, 0, sizeof(_nkro));
+    memset(_sent, 0, sizeof(_sent));
+    memset(_down, 0, sizeof(_down));
+}
+
+void KeyboardReport::setFormat(Format format) {
+    if (format == _format) return;
+    _format = format;
+    resync();
+}
+
+void KeyboardReport::setKey(uint8_t usage, bool down) {
+    uint8_t* keys = _report + 2;
+    uint8_t bit = 1 << (usage & 7);
+    if (down) {
+        if (_down[usage >> 3] & bit) return;
+        _down[usage >> 3] |= bit;
+        for (int i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+            if (keys[i] == 0) {
+                keys[i] = usage;
+                return;
+            }
+        }
+        // All six slots taken: the key stays in the bitmap until one frees
+        // (the NKRO report has it already)
+        if (_format == FORMAT_BOOT) _overflows++;
+    } else {
+        if (!(_down[usage >> 3] & bit)) return;
+        _down[usage >> 3] &= ~bit;
+        for (int i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+            if (keys[i] == usage) {
+                keys[i] = 0;
+                backfill();
+                return;
+            }
+        }
+    }
+}
+
+// Move held-back keys into freed slots, lowest usage first
+void KeyboardReport::backfill() {
+    uint8_t* keys = _report + 2;
+    int slot = 0;
+    for (int usage = 1; usage < 256; usage++) {
+        if (!(_down[usage >> 3] & (1 << (usage & 7)))) continue;
+        bool inSlot = false;
+        for (int i = 0; i < KEYBOARD_REPORT_KEYS; i++) {
+            if (keys[i] == usage) inSlot = true;
+        }
+        if (inSlot) continue;
+        while (slot < KEYBOARD_REPORT_KEYS && keys[slot]) slot++;
+        if (slot == KEYBOARD_REPORT_KEYS) return;
+        keys[slot] = (uint8_t)usage;
+    }
+}
+
+void KeyboardReport::updateModifiers() {
+    uint8_t mods = _heldMods;
+    if (_strokeUsage) mods = (mods & ~STROKE_MOD_MASK) | _strokeMods;
+    _report[0] = mods;
+    _nkro[0] = mods;
+    memcpy(_nkro + 1, _down, KEYBOARD_NKRO_SIZE - 1);
+}
+
+void KeyboardReport::press(uint8_t usage) {
+    if (!usage) return;
+    uint8_t bit = hid_keymap::modifierBit(usage);
+    if (bit) _heldMods |= bit;
+    else setKey(usage, true);
+    updateModifiers();
+}
+
+void KeyboardReport::release(uint8_t usage) {
+    if (!usage) return;
+    uint8_t bit = hid_keymap::modifierBit(usage);
+    if (bit) _heldMods &= ~bit;
+    else setKey(usage, false);
+    updateModifiers();
+}
+
+void KeyboardReport::pressStroke(uint8_t usage, uint8_t strokeMods) {
+    if (!usage) return;
+    setKey(usage, true);
+    _strokeUsage = usage;
+    _strokeMods = strokeMods;
+    updateModifiers();
+}
+
+void KeyboardReport::releaseStroke(uint8_t usage) {
+    if (!usage) return;
+    setKey(usage, false);
+    if (usage == _strokeUsage) _strokeUsage = 0;
+    updateModifiers();
+}
+
+bool KeyboardReport::reconcile(uint8_t serverMods) {
+    // Ctrl, Shift, Alt, GUI: left bit | right bit
+    static const uint8_t CLASSES[] = { 0x11, 0x22, 0x44, 0x88 };
+    uint8_t held = _heldMods;
+    for (uint8_t both : CLASSES) {
+        if (!(serverMods & both)) held &= ~both;
+        else if (!(held & both)) held |= serverMods & both;
+    }
+    if (held == _heldMods) return false;
+    _heldMods = held;
+    updateModifiers();
+    return true;
+}
+
+void KeyboardReport::clear() {
+    _heldMods = 0;
+    _strokeUsage = 0;
+    memset(_report, 0, sizeof(_report));
+    memset(_nkro, 0, sizeof(_nkro));
+    memset(_down, 0, sizeof(_down));
+}
+
+bool KeyboardReport::pending() const {
+    return memcmp(bytes(), _sent, size()) != 0;
+}
+
+void KeyboardReport::markSent() {
+    memcpy(_sent, bytes(), size());
+}
+
+void KeyboardReport::resync() {
+    // Never matches a real report: the boot reserved byte is always 0, and
+    // usage 0 (the first NKRO bit) is never pressed
+    memset(_sent, 0xFF, sizeof(_sent));
+}
+
+bool KeyboardReport::empty() const {
+    for (uint8_t b : _report) {
+        if (b) return false;
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+/**
+ * Input latency instrumentation — implementation
+ * Log-linear histograms: exact below 16 us, then four buckets per power of two
+ * (25% resolution) up to the full 32-bit range.
+ */
+
+#include "../include/latency.h"
+#include <atomic>
+#include <string.h>
+
+namespace latency {
+
+static const uint32_t LINEAR_BUCKETS = 16;
+static const uint32_t BUCKET_COUNT = LINEAR_BUCKETS + (32 - 4) * 4;
+
+struct Histogram {
+    uint32_t buckets[BUCKET_COUNT];
+    uint32_t count;
+    uint32_t max;
+};
+
+static Histogram _stages[STAGE_COUNT];
+
+// Clear requests from reset(), acted on by each stage's writer so the
+// histogram keeps a single writer
+static std::atomic<bool> _resetRequested[STAGE_COUNT];
+
+static const char* const STAGE_NAMES[STAGE_COUNT] = {
+    "rx->decode",
+    "rx->dispatch",
+    "rx->ble",
+};
+
+static uint32_t bucketFor(uint32_t us) {
+    if (us < LINEAR_BUCKETS) return us;
+    uint32_t exp = 31 - __builtin_clz(us);  // >= 4
+    uint32_t sub = (us >> (exp - 2)) & 3;
+    return LINEAR_BUCKETS + (exp - 4) * 4 + sub;
+}
+
+static uint32_t bucketUpperBound(uint32_t bucket) {
+    if (bucket < LINEAR_BUCKETS) return bucket;
+    uint32_t exp = 4 + (bucket - LINEAR_BUCKETS) / 4;
+    uint32_t sub = (bucket - LINEAR_BUCKETS) % 4;
+    uint64_t lower = (uint64_t)(4 + sub) << (exp - 2);
+    uint64_t upper = lower + ((uint64_t)1 << (exp - 2)) - 1;
+    return upper > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)upper;
+}
+
+static uint32_t percentile(const Histogram& h, uint32_t count, uint32_t pct) {
+    if (!count) return 0;
+    uint32_t target = (uint32_t)(((uint64_t)count * pct + 99) / 100);
+    uint32_t seen = 0;
+    for (uint32_t b = 0; b < BUCKET_COUNT; b++) {
+        seen += h.buckets[b];
+        if (seen >= target) {
+            uint32_t bound = bucketUpperBound(b);
+            return bound < h.max ? bound : h.max;
+        }
+    }
+    return h.max;
+}
+
+void record(Stage stage, uint32_t micros) {
+    if (stage >= STAGE_COUNT) return;
+    Histogram& h = _stages[stage];
+    if (_resetRequested[stage].load(std::memory_order_relaxed) &&
+        _resetRequested[stage].exchange(false, std::memory_order_acquire)) {
+        memset(&h, 0, sizeof(h));
+    }
+    h.buckets[bucketFor(micros)]++;
+    h.count++;
+    if (micros > h.max) h.max = micros;
+}
+
+Summary summary(Stage stage) {
+    Summary s = { 0, 0, 0, 0 };
+    if (stage >= STAGE_COUNT) return s;
+    if (_resetRequested[stage].load(std::memory_order_relaxed)) return s;  // Cleared on next record()
+    const Histogram& h = _stages[stage];
+    s.count = h.count;
+    s.p50 = percentile(h, s.count, 50);
+    s.p99 = percentile(h, s.count, 99);
+    s.max = h.max;
+    return s;
+}
+
+String report() {
+    String out = "stage         count      p50us    p99us    maxus\n";
+    for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+        Summary s = summary((Stage)i);
+        char line[80];
+        snprintf(line, sizeof(line), "%-12s %6u %9u %8u %8u\n", STAGE_NAMES[i],
+                 (unsigned)s.count, (unsigned)s.p50, (unsigned)s.p99, (unsigned)s.max);
+        out += line;
+    }
+    return out;
+}
+
+void reset() {
+    for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+        _resetRequested[i].store(true, std::memory_order_release);
+    }
+}
+
+} // namespace latency
@@ -9,6 +9,7 @@
 #include "ble_hid.h"
 #include "deskflow_server.h"
 #include "web_ui.h"
+#include "latency.h"
 #include <Ethernet.h>
 
 void setup() {
@@ -61,7 +62,9 @@ void loop() {
     // Update remote endpoint from WebUI (if set)
     deskflow::setRemoteEndpoint(web_ui::getDeskflowServerUrl());
     deskflow::poll();
-    ble_hid::poll();
+#if !HID_TASK_ENABLED
+    ble_hid::poll();  // Otherwise polled by the HID task (see deskflow_server.cpp)
+#endif
     web_ui::poll();
 
     // Heartbeat every 30s (reduced from 10s to reduce log spam)
@@ -69,6 +72,8 @@ void loop() {
     if (now - _lastLog >= 30000) {
         _lastLog = now;
         Serial.println("[Deskflow] running | IP " + ethernet::getLocalIP().toString() + " | BLE " + (ble_hid::isConnected() ? "connected" : "advertising"));
+        Serial.print(latency::report());
+        Serial.print(deskflow::messageReport());
     }
     delay(1);
 }
@@ -3,17 +3,72 @@
  */
 
 #include "../include/synergy_protocol.h"
+#include "../include/latency.h"
 #include <string.h>
 
 namespace synergy {
 
+static_assert((SYNERGY_RECV_BUFFER_SIZE & (SYNERGY_RECV_BUFFER_SIZE - 1)) == 0,
+              "SYNERGY_RECV_BUFFER_SIZE must be a power of two");
+static_assert(SYNERGY_MAX_FRAME_SIZE <= SYNERGY_RECV_BUFFER_SIZE,
+              "SYNERGY_MAX_FRAME_SIZE must fit in the receive ring");
+
+static const uint32_t RECV_MASK = SYNERGY_RECV_BUFFER_SIZE - 1;
+
+// DCLP fixed header: length(4) "DCLP" id(1) sequence(4) mark(1) dataLength(4)
+static const uint32_t DCLP_HEADER_SIZE = 18;
+
+// DCLP chunk marks (protocol 1.6+)
+enum ClipboardMark : uint8_t {
+    CLIP_MARK_START = 1,  // Data is the total size as a decimal string
+    CLIP_MARK_CHUNK = 2,  // Data is the next slice of the serialized clipboard
+    CLIP_MARK_END = 3,
+};
+
+// Serialized clipboard fields
+enum ClipboardState : uint8_t {
+    CLIP_COUNT,
+    CLIP_FORMAT,
+    CLIP_SIZE,
+    CLIP_DATA,
+    CLIP_DONE,
+};
+
+static const uint32_t CLIP_FORMAT_TEXT = 0;
+
+// Features available at a given protocol minor version
+static uint16_t featuresForMinor(uint16_t minor) {
+    uint16_t f = FEATURE_OPTIONS;
+    if (minor >= 2) f |= FEATURE_RELATIVE_MOVES;
+    if (minor >= 3) f |= FEATURE_KEEPALIVE;
+    if (minor >= 6) f |= FEATURE_CLIPBOARD_CHUNKS;
+    if (minor >= 7) f |= FEATURE_SECURE_INPUT;
+    if (minor >= 8) f |= FEATURE_LANGUAGE_SYNC;
+    return f;
+}
+
+// Registry length check, out of line so zero-argument entries don't compare
+// an unsigned length against 0 (-Wtype-limits)
+static inline bool hasArgs(uint32_t argLen, uint32_t minArgs) {
+    return argLen >= minArgs;
+}
+
 SynergyClient::SynergyClient()
-    : _screenWidth(1920)
-    , _screenHeight(1080)
+    : _keepAlivePeriodMs(SYNERGY_KEEPALIVE_PERIOD_MS)
+    , _keepAliveMultiple(SYNERGY_KEEPALIVE_MULTIPLE)
+    , _dropReason(DROP_NONE)
     , _mouseCallback(nullptr)
+    , _relativeMouseCallback(nullptr)
     , _keyboardCallback(nullptr)
     , _screenActiveCallback(nullptr)
+    , _clipboardCallback(nullptr)
 {
+    memset(&_stats, 0, sizeof(_stats));
+    memset(_messageCounters, 0, sizeof(_messageCounters));
+    _screen.x = _screen.y = 0;
+    _screen.width = 1920;
+    _screen.height = 1080;
+    _rxMicros = _decodeMicros = 0;
     strncpy(_clientName, "ESP32-Deskflow", sizeof(_clientName) - 1);
     _clientName[sizeof(_clientName) - 1] = '\0';
     reset();
@@ -23,10 +78,24 @@ void SynergyClient::reset() {
     _connected = false;
     _hasReceivedHello = false;
     _captured = false;
+    _accepted = false;
     _sequenceNumber = 0;
-    _recvOfs = 0;
+    _serverProtocol = "";
+    _protocolMinor = 0;
+    _features = 0;
+    _serverLanguages[0] = '\0';
+    resetOptions();
+    _screenInfoDirty = false; // The server asks with QINF after the hello
+    _lastReceiveMs = millis();
+    _recvHead = 0;
+    _recvTail = 0;
+    _rxMarkCount = 0;
     _skipBytes = 0;
-    _replyCur = _replyBuffer + 4; // Leave room for length header
+    _skipToClipboard = false;
+    memset(&_clip, 0, sizeof(_clip));
+    _replyStart = 0;
+    _replyPos = 4; // Leave room for length header
+    _replyOverflow = false;
     _mouseX = _mouseY = 0;
     _mouseWheelX = _mouseWheelY = 0;
     _mouseLeft = _mouseMiddle = _mouseRight = false;
@@ -39,269 +108,700 @@ void SynergyClient::setClientName(const char* name) {
     }
 }
 
-void SynergyClient::setScreenSize(uint16_t width, uint16_t height) {
-    _screenWidth = width;
-    _screenHeight = height;
+void SynergyClient::setScreenGeometry(const ScreenGeometry& geometry) {
+    if (memcmp(&geometry, &_screen, sizeof(_screen)) == 0) return;
+    _screen = geometry;
+    _screenInfoDirty = _connected;
 }
 
 int16_t SynergyClient::netToNative16(const uint8_t* data) {
     return (data[0] << 8) | data[1];
 }
 
+void SynergyClient::readString(const uint8_t* args, uint32_t argLen, char* out, size_t outSize) {
+    // Synergy string: length(4) then bytes; keep what fits and is printable
+    uint32_t len = (uint32_t)netToNative32(args);
+    if (len > argLen - 4) len = argLen - 4;
+    size_t n = 0;
+    for (uint32_t i = 0; i < len && n + 1 < outSize; i++) {
+        char c = (char)args[4 + i];
+        if (c >= 0x20 && c < 0x7F) out[n++] = c;
+    }
+    out[n] = '\0';
+}
+
+String SynergyClient::featureNames(uint16_t features) {
+    static const char* const NAMES[] = {
+        "relative moves", "keep-alive", "options", "clipboard chunks",
+        "secure input", "language sync",
+    };
+    String out;
+    for (uint8_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); i++) {
+        if (!(features & (1 << i))) continue;
+        if (out.length()) out += ", ";
+        out += NAMES[i];
+    }
+    return out;
+}
+
 int32_t SynergyClient::netToNative32(const uint8_t* data) {
-    return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    // Assemble unsigned: data[0] << 24 on a promoted int overflows for bytes >= 0x80
+    return (int32_t)(((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                     ((uint32_t)data[2] << 8) | (uint32_t)data[3]);
+}
+
+bool SynergyClient::replyRoom(size_t len) {
+    if (_replyPos + len <= SYNERGY_REPLY_BUFFER_SIZE) return true;
+    _replyOverflow = true;
+    return false;
 }
 
 void SynergyClient::addString(const char* str) {
     size_t len = strlen(str);
-    memcpy(_replyCur, str, len);
-    _replyCur += len;
+    if (!replyRoom(len)) return;
+    memcpy(_replyBuffer + _replyPos, str, len);
+    _replyPos += len;
 }
 
 void SynergyClient::addUInt8(uint8_t val) {
-    *_replyCur++ = val;
+    if (!replyRoom(1)) return;
+    _replyBuffer[_replyPos++] = val;
 }
 
 void SynergyClient::addUInt16(uint16_t val) {
-    *_replyCur++ = (uint8_t)(val >> 8);
-    *_replyCur++ = (uint8_t)val;
+    if (!replyRoom(2)) return;
+    _replyBuffer[_replyPos++] = (uint8_t)(val >> 8);
+    _replyBuffer[_replyPos++] = (uint8_t)val;
 }
 
 void SynergyClient::addUInt32(uint32_t val) {
-    *_replyCur++ = (uint8_t)(val >> 24);
-    *_replyCur++ = (uint8_t)(val >> 16);
-    *_replyCur++ = (uint8_t)(val >> 8);
-    *_replyCur++ = (uint8_t)val;
+    if (!replyRoom(4)) return;
+    _replyBuffer[_replyPos++] = (uint8_t)(val >> 24);
+    _replyBuffer[_replyPos++] = (uint8_t)(val >> 16);
+    _replyBuffer[_replyPos++] = (uint8_t)(val >> 8);
+    _replyBuffer[_replyPos++] = (uint8_t)val;
+}
+
+void SynergyClient::beginReply(Client& client) {
+    // Start a new frame after any staged ones, leaving room for its length
+    // header. If the buffer is getting full, push the staged frames out first.
+    if (_replyStart + 4 + SYNERGY_MAX_REPLY_SIZE > SYNERGY_REPLY_BUFFER_SIZE) {
+        flushReplies(client);
+    }
+    _replyPos = _replyStart + 4;
+    _replyOverflow = false;
 }
 
-bool SynergyClient::sendReply(Client& client) {
-    uint32_t replyLen = (uint32_t)(_replyCur - _replyBuffer);
-    uint32_t bodyLen = replyLen - 4;
+bool SynergyClient::queueReply() {
+    if (_replyOverflow) {
+        // Drop the partial frame rather than send a corrupt one
+        Serial.println("[Synergy] Reply too large for buffer, dropped");
+        _replyPos = _replyStart + 4;
+        _replyOverflow = false;
+        return false;
+    }
     
     // Write length header (big-endian)
-    _replyBuffer[0] = (uint8_t)(bodyLen >> 24);
-    _replyBuffer[1] = (uint8_t)(bodyLen >> 16);
-    _replyBuffer[2] = (uint8_t)(bodyLen >> 8);
-    _replyBuffer[3] = (uint8_t)bodyLen;
+    uint32_t bodyLen = (uint32_t)(_replyPos - _replyStart - 4);
+    uint8_t* hdr = _replyBuffer + _replyStart;
+    hdr[0] = (uint8_t)(bodyLen >> 24);
+    hdr[1] = (uint8_t)(bodyLen >> 16);
+    hdr[2] = (uint8_t)(bodyLen >> 8);
+    hdr[3] = (uint8_t)bodyLen;
+    
+    _replyStart = _replyPos;
+    return true;
+}
+
+bool SynergyClient::flushReplies(Client& client) {
+    if (_replyStart == 0) return true;
     
-    size_t written = client.write(_replyBuffer, replyLen);
+    // All staged frames go out in one write (one SEND_OK wait on the W5500)
+    size_t len = _replyStart;
+    size_t written = client.write(_replyBuffer, len);
+    _stats.replyWrites++;
     
     // Reset reply buffer
-    _replyCur = _replyBuffer + 4;
+    _replyStart = 0;
+    _replyPos = 4;
     
-    return written == replyLen;
+    return written == len;
+}
+
+void SynergyClient::notifyMouse() {
+    if (_mouseCallback) {
+        _mouseCallback(_mouseX, _mouseY, _mouseWheelX, _mouseWheelY,
+                      _mouseLeft, _mouseMiddle, _mouseRight);
+    }
 }
 
 void SynergyClient::processMessage(Client& client, const uint8_t* msg, uint32_t len) {
     if (len < 8) return; // Need at least 4-byte length + 4-byte command
     
+    _decodeMicros = latency::now();
     const uint8_t* cmd = msg + 4; // Skip length header
-    uint32_t bodyLen = len - 4;
+    const uint8_t* args = cmd + 4;
+    uint32_t argLen = len - 8;
     
-    // QINF - Query screen info
-    if (memcmp(cmd, "QINF", 4) == 0) {
-        Serial.println("[Synergy] QINF - sending screen info");
-        addString("DINF");
-        addUInt16(0);              // x origin
-        addUInt16(0);              // y origin
-        addUInt16(_screenWidth);   // width
-        addUInt16(_screenHeight);  // height
-        addUInt16(0);              // warp size
-        addUInt16(0);              // mouse x
-        addUInt16(0);              // mouse y
-        sendReply(client);
-        return;
+    // Constant-time dispatch on the big-endian FourCC; handlers and their
+    // minimum argument lengths are registered in SYNERGY_MESSAGES.
+    MessageId id = MSG_UNKNOWN;
+    switch ((uint32_t)netToNative32(cmd)) {
+#define SYNERGY_DISPATCH(name, minArgs, minMinor, handler)        \
+        case fourcc(#name):                                       \
+            if (_protocolMinor < (minMinor)) break;               \
+            id = MSG_##name;                                      \
+            if (hasArgs(argLen, (minArgs))) handler(client, args, argLen); \
+            else handleMalformed(cmd, argLen);                    \
+            break;
+        SYNERGY_MESSAGES(SYNERGY_DISPATCH)
+#undef SYNERGY_DISPATCH
+        default:
+            break;
     }
+    countMessage(id, len, _decodeMicros);
+    if (id != MSG_UNKNOWN) return;
     
-    // CIAK - Info acknowledgment
-    if (memcmp(cmd, "CIAK", 4) == 0) {
-        // Just acknowledge, nothing to do
-        return;
+    // Unknown packet (only log once per packet type to reduce spam)
+    char pktId[5] = {0};
+    memcpy(pktId, cmd, 4);
+    static char lastUnknown[5] = {0};
+    if (memcmp(pktId, lastUnknown, 4) != 0) {
+        Serial.println("[Synergy] Unknown packet: " + String(pktId));
+        memcpy(lastUnknown, pktId, 4);
     }
-    
-    // CROP - Reset options
-    if (memcmp(cmd, "CROP", 4) == 0) {
-        return;
+}
+
+const char* SynergyClient::messageName(MessageId id) {
+    static const char* const NAMES[MSG_COUNT] = {
+#define SYNERGY_MESSAGE_NAME(name, minArgs, minMinor, handler) #name,
+        SYNERGY_MESSAGES(SYNERGY_MESSAGE_NAME)
+#undef SYNERGY_MESSAGE_NAME
+        "????",
+    };
+    return id < MSG_COUNT ? NAMES[id] : NAMES[MSG_UNKNOWN];
+}
+
+MessageId SynergyClient::messageIdFor(uint32_t code) {
+    switch (code) {
+#define SYNERGY_MESSAGE_CASE(name, minArgs, minMinor, handler) case fourcc(#name): return MSG_##name;
+        SYNERGY_MESSAGES(SYNERGY_MESSAGE_CASE)
+#undef SYNERGY_MESSAGE_CASE
+        default: return MSG_UNKNOWN;
     }
-    
-    // DSOP - Set options
-    if (memcmp(cmd, "DSOP", 4) == 0) {
-        return;
+}
+
+void SynergyClient::countMessage(MessageId id, uint32_t bytes, uint32_t startMicros) {
+    MessageCounter& c = _messageCounters[id];
+    c.count++;
+    c.bytes += bytes;
+    c.lastSeenMs = millis();
+    c.handlerMicros += latency::now() - startMicros;
+}
+
+// Known command with fewer argument bytes than its handler reads
+void SynergyClient::handleMalformed(const uint8_t* cmd, uint32_t argLen) {
+    _stats.malformed++;
+    Serial.printf("[Synergy] Malformed %.4s (%u arg bytes), dropped\n", (const char*)cmd, (unsigned)argLen);
+}
+
+// DMMV - Mouse move: x(2) y(2)
+void SynergyClient::handleMouseMove(Client&, const uint8_t* args, uint32_t) {
+    _mouseX = netToNative16(args);
+    _mouseY = netToNative16(args + 2);
+    notifyMouse();
+}
+
+// DMRM - Relative mouse move: dx(2) dy(2)
+// Sent instead of DMMV when the server has relativeMouseMoves on and the cursor is locked to us
+void SynergyClient::handleMouseRelativeMove(Client&, const uint8_t* args, uint32_t) {
+    int16_t dx = netToNative16(args);
+    int16_t dy = netToNative16(args + 2);
+    if (_relativeMouseCallback) {
+        _relativeMouseCallback(dx, dy, _mouseLeft, _mouseMiddle, _mouseRight);
     }
-    
-    // CALV - Keep-alive
-    if (memcmp(cmd, "CALV", 4) == 0) {
-        // Reply with CALV then CNOP
-        addString("CALV");
-        sendReply(client);
-        addString("CNOP");
-        sendReply(client);
-        return;
+}
+
+// DMDN - Mouse down: button(1)
+void SynergyClient::handleMouseDown(Client&, const uint8_t* args, uint32_t) {
+    uint8_t btn = args[0] - 1;
+    if (btn == 0) _mouseLeft = true;
+    else if (btn == 1) _mouseMiddle = true;
+    else if (btn == 2) _mouseRight = true;
+    notifyMouse();
+}
+
+// DMUP - Mouse up: button(1)
+void SynergyClient::handleMouseUp(Client&, const uint8_t* args, uint32_t) {
+    uint8_t btn = args[0] - 1;
+    if (btn == 0) _mouseLeft = false;
+    else if (btn == 1) _mouseMiddle = false;
+    else if (btn == 2) _mouseRight = false;
+    notifyMouse();
+}
+
+// DMWM - Mouse wheel: xDelta(2) yDelta(2)
+void SynergyClient::handleMouseWheel(Client&, const uint8_t* args, uint32_t) {
+    _mouseWheelX = netToNative16(args);
+    _mouseWheelY = netToNative16(args + 2);
+    notifyMouse();
+    // Reset wheel values after processing so they don't persist to move events
+    _mouseWheelX = 0;
+    _mouseWheelY = 0;
+}
+
+// DKDN - Key down: keyId(2) modifiers(2) button(2)
+void SynergyClient::handleKeyDown(Client&, const uint8_t* args, uint32_t) {
+    uint16_t id = netToNative16(args);
+    uint16_t mod = netToNative16(args + 2);
+    uint16_t key = netToNative16(args + 4);
+    if (_keyboardCallback) {
+        _keyboardCallback(id, mod, key, true, false);
     }
-    
-    // CINN - Enter screen
-    if (memcmp(cmd, "CINN", 4) == 0) {
-        if (len >= 16) {
-            _sequenceNumber = netToNative32(cmd + 8);
-        }
-        _captured = true;
-        Serial.println("[Synergy] Screen entered");
-        if (_screenActiveCallback) _screenActiveCallback(true);
-        addString("CNOP");
-        sendReply(client);
-        return;
+}
+
+// DKUP - Key up: keyId(2) modifiers(2) button(2)
+void SynergyClient::handleKeyUp(Client&, const uint8_t* args, uint32_t) {
+    uint16_t id = netToNative16(args);
+    uint16_t mod = netToNative16(args + 2);
+    uint16_t key = netToNative16(args + 4);
+    if (_keyboardCallback) {
+        _keyboardCallback(id, mod, key, false, false);
     }
-    
-    // COUT - Leave screen
-    if (memcmp(cmd, "COUT", 4) == 0) {
-        _captured = false;
-        Serial.println("[Synergy] Screen left");
-        if (_screenActiveCallback) _screenActiveCallback(false);
-        addString("CNOP");
-        sendReply(client);
-        return;
+}
+
+// DKRP - Key repeat: keyId(2) modifiers(2) count(2) button(2)
+void SynergyClient::handleKeyRepeat(Client&, const uint8_t* args, uint32_t) {
+    uint16_t id = netToNative16(args);
+    uint16_t mod = netToNative16(args + 2);
+    uint16_t key = netToNative16(args + 6);
+    if (_keyboardCallback) {
+        _keyboardCallback(id, mod, key, true, true);
     }
-    
-    // DMMV - Mouse move
-    if (memcmp(cmd, "DMMV", 4) == 0) {
-        if (len >= 12) {
-            _mouseX = netToNative16(cmd + 4);
-            _mouseY = netToNative16(cmd + 6);
-            if (_mouseCallback) {
-                _mouseCallback(_mouseX, _mouseY, _mouseWheelX, _mouseWheelY,
-                              _mouseLeft, _mouseMiddle, _mouseRight);
-            }
-        }
-        return;
+}
+
+// CALV - Keep-alive
+void SynergyClient::handleKeepAlive(Client& client, const uint8_t*, uint32_t) {
+    _accepted = true;
+    // Reply with CALV then CNOP (sent together when update() flushes)
+    beginReply(client);
+    addString("CALV");
+    queueReply();
+    beginReply(client);
+    addString("CNOP");
+    queueReply();
+}
+
+// QINF - Query screen info
+void SynergyClient::handleQueryInfo(Client& client, const uint8_t*, uint32_t) {
+    Serial.println("[Synergy] QINF - sending screen info");
+    _accepted = true;
+    sendScreenInfo(client);
+}
+
+// DINF - Screen info: x(2) y(2) width(2) height(2) warp(2) mouseX(2) mouseY(2).
+// Answers QINF, and is sent unsolicited when the geometry changes.
+void SynergyClient::sendScreenInfo(Client& client) {
+    beginReply(client);
+    addString("DINF");
+    addUInt16((uint16_t)_screen.x);
+    addUInt16((uint16_t)_screen.y);
+    addUInt16(_screen.width);
+    addUInt16(_screen.height);
+    addUInt16(0);                  // warp size (obsolete)
+    addUInt16((uint16_t)_mouseX);
+    addUInt16((uint16_t)_mouseY);
+    queueReply();
+    _screenInfoDirty = false;
+}
+
+// CINN - Enter screen: x(2) y(2) sequence(4) modifiers(2)
+void SynergyClient::handleEnter(Client& client, const uint8_t* args, uint32_t argLen) {
+    if (argLen >= 4) {
+        _mouseX = netToNative16(args);
+        _mouseY = netToNative16(args + 2);
     }
-    
-    // DMDN - Mouse down
-    if (memcmp(cmd, "DMDN", 4) == 0) {
-        if (len >= 9) {
-            uint8_t btn = cmd[4] - 1;
-            if (btn == 0) _mouseLeft = true;
-            else if (btn == 1) _mouseMiddle = true;
-            else if (btn == 2) _mouseRight = true;
-            if (_mouseCallback) {
-                _mouseCallback(_mouseX, _mouseY, _mouseWheelX, _mouseWheelY,
-                              _mouseLeft, _mouseMiddle, _mouseRight);
-            }
-        }
-        return;
+    if (argLen >= 8) {
+        _sequenceNumber = netToNative32(args + 4);
     }
-    
-    // DMUP - Mouse up
-    if (memcmp(cmd, "DMUP", 4) == 0) {
-        if (len >= 9) {
-            uint8_t btn = cmd[4] - 1;
-            if (btn == 0) _mouseLeft = false;
-            else if (btn == 1) _mouseMiddle = false;
-            else if (btn == 2) _mouseRight = false;
-            if (_mouseCallback) {
-                _mouseCallback(_mouseX, _mouseY, _mouseWheelX, _mouseWheelY,
-                              _mouseLeft, _mouseMiddle, _mouseRight);
+    _captured = true;
+    _accepted = true;
+    Serial.println("[Synergy] Screen entered");
+    if (_screenActiveCallback) _screenActiveCallback(true);
+    beginReply(client);
+    addString("CNOP");
+    queueReply();
+}
+
+// COUT - Leave screen
+void SynergyClient::handleLeave(Client& client, const uint8_t*, uint32_t) {
+    _captured = false;
+    Serial.println("[Synergy] Screen left");
+    if (_screenActiveCallback) _screenActiveCallback(false);
+    beginReply(client);
+    addString("CNOP");
+    queueReply();
+}
+
+// DCLP - Clipboard data: id(1) sequence(4) mark(1) data(string)
+void SynergyClient::handleClipboard(Client&, const uint8_t* args, uint32_t argLen) {
+    uint32_t dataLen = (uint32_t)netToNative32(args + 6);
+    if (dataLen > argLen - 10) dataLen = argLen - 10;
+    clipboardChunk(args[0], args[5], dataLen);
+    clipboardFeed(args + 10, dataLen);
+}
+
+void SynergyClient::clipboardChunk(uint8_t id, uint8_t mark, uint32_t dataLen) {
+    _clip.chunkLeft = 0;
+    switch (mark) {
+        case CLIP_MARK_START:
+            // Size string is informational; the serialized data follows in chunks.
+            // With sharing turned off on the server, drain without parsing.
+            memset(&_clip, 0, sizeof(_clip));
+            if (!_options.clipboardSharing) break;
+            _clip.active = true;
+            _clip.id = id;
+            _clip.state = CLIP_COUNT;
+            break;
+        case CLIP_MARK_CHUNK:
+            if (_clip.active && _clip.id == id) _clip.chunkLeft = dataLen;
+            break;
+        case CLIP_MARK_END:
+            if (_clip.active && _clip.id == id) {
+                _clip.active = false;
+                if (_clipboardCallback) _clipboardCallback(id, nullptr, 0, true);
             }
-        }
-        return;
+            break;
+        default:
+            break;
     }
+}
+
+void SynergyClient::clipboardFeed(const uint8_t* data, uint32_t len) {
+    // Only bytes belonging to an accepted chunk are parsed; anything else
+    // (start-mark size string, padding, unknown marks) is dropped.
+    if (len > _clip.chunkLeft) len = _clip.chunkLeft;
+    _clip.chunkLeft -= len;
     
-    // DMWM - Mouse wheel
-    if (memcmp(cmd, "DMWM", 4) == 0) {
-        if (len >= 12) {
-            _mouseWheelX = netToNative16(cmd + 4);
-            _mouseWheelY = netToNative16(cmd + 6);
-            if (_mouseCallback) {
-                _mouseCallback(_mouseX, _mouseY, _mouseWheelX, _mouseWheelY,
-                              _mouseLeft, _mouseMiddle, _mouseRight);
+    while (len > 0) {
+        if (_clip.state == CLIP_DONE) return;
+        
+        if (_clip.state == CLIP_DATA) {
+            uint32_t take = len < _clip.dataLeft ? len : _clip.dataLeft;
+            if (_clip.format == CLIP_FORMAT_TEXT && _clipboardCallback) {
+                _clipboardCallback(_clip.id, data, take, false);
             }
-            // Reset wheel values after processing so they don't persist to move events
-            _mouseWheelX = 0;
-            _mouseWheelY = 0;
-        }
-        return;
-    }
-    
-    // DKDN - Key down
-    if (memcmp(cmd, "DKDN", 4) == 0) {
-        if (len >= 12) {
-            uint16_t mod = netToNative16(cmd + 6);
-            uint16_t key = netToNative16(cmd + 8);
-            if (_keyboardCallback) {
-                _keyboardCallback(key, mod, true, false);
+            data += take;
+            len -= take;
+            _clip.dataLeft -= take;
+            if (_clip.dataLeft == 0) {
+                _clip.state = (--_clip.formatsLeft > 0) ? CLIP_FORMAT : CLIP_DONE;
             }
+            continue;
+        }
+        
+        // Collect a 4-byte big-endian field, possibly split across chunks
+        _clip.field[_clip.fieldLen++] = *data++;
+        len--;
+        if (_clip.fieldLen < 4) continue;
+        _clip.fieldLen = 0;
+        uint32_t value = (uint32_t)netToNative32(_clip.field);
+        
+        switch (_clip.state) {
+            case CLIP_COUNT:
+                _clip.formatsLeft = value;
+                _clip.state = value ? CLIP_FORMAT : CLIP_DONE;
+                break;
+            case CLIP_FORMAT:
+                _clip.format = value;
+                _clip.state = CLIP_SIZE;
+                break;
+            case CLIP_SIZE:
+                _clip.dataLeft = value;
+                if (value) _clip.state = CLIP_DATA;
+                else _clip.state = (--_clip.formatsLeft > 0) ? CLIP_FORMAT : CLIP_DONE;
+                break;
         }
-        return;
     }
+}
+
+// SECN - Secure input on the server (1.7+): app(string).
+// Keystrokes are withheld from us while a password field has focus there.
+void SynergyClient::handleSecureInput(Client&, const uint8_t* args, uint32_t argLen) {
+    char app[48];
+    readString(args, argLen, app, sizeof(app));
+    Serial.printf("[Synergy] Server secure input enabled by '%s'\n", app);
+}
+
+// LSYN - Language synchronisation (1.8+): languages(string) of 2-letter codes
+void SynergyClient::handleLanguageSync(Client&, const uint8_t* args, uint32_t argLen) {
+    readString(args, argLen, _serverLanguages, sizeof(_serverLanguages));
+    Serial.printf("[Synergy] Server languages: %s\n", _serverLanguages);
+}
+
+void SynergyClient::resetOptions() {
+    memset(&_options, 0, sizeof(_options));
+    _options.clipboardSharing = true;
+}
+
+// CROP - Reset options to their defaults
+void SynergyClient::handleResetOptions(Client&, const uint8_t*, uint32_t) {
+    resetOptions();
+}
+
+// DSOP - Set options: count(4) then count/2 pairs of id(4 FourCC) value(4)
+void SynergyClient::handleSetOptions(Client&, const uint8_t* args, uint32_t argLen) {
+    uint32_t count = (uint32_t)netToNative32(args);
+    uint32_t avail = (argLen - 4) / 4;
+    if (count > avail) count = avail;
     
-    // DKUP - Key up
-    if (memcmp(cmd, "DKUP", 4) == 0) {
-        if (len >= 12) {
-            uint16_t mod = netToNative16(cmd + 6);
-            uint16_t key = netToNative16(cmd + 8);
-            if (_keyboardCallback) {
-                _keyboardCallback(key, mod, false, false);
-            }
+    const uint8_t* p = args + 4;
+    for (uint32_t i = 0; i + 1 < count; i += 2, p += 8) {
+        uint32_t id = (uint32_t)netToNative32(p);
+        int32_t value = netToNative32(p + 4);
+        switch (id) {
+            case fourcc("HART"):
+                _options.hasHeartbeat = true;
+                _options.heartbeatMs = value > 0 ? (uint32_t)value : 0;
+                break;
+            case fourcc("MDLT"): _options.relativeMouseMoves = value != 0; break;
+            case fourcc("SSVR"): _options.screenSaverSync = value != 0; break;
+            case fourcc("CLPS"): _options.clipboardSharing = value != 0; break;
+            case fourcc("HDCL"): _options.halfDuplexCapsLock = value != 0; break;
+            case fourcc("HDNL"): _options.halfDuplexNumLock = value != 0; break;
+            case fourcc("HDSL"): _options.halfDuplexScrollLock = value != 0; break;
+            default: break; // Screen switching, modifier remaps etc. are server-side
         }
-        return;
     }
     
-    // DKRP - Key repeat
-    if (memcmp(cmd, "DKRP", 4) == 0) {
-        if (len >= 14) {
-            uint16_t mod = netToNative16(cmd + 6);
-            uint16_t key = netToNative16(cmd + 10);
-            if (_keyboardCallback) {
-                _keyboardCallback(key, mod, true, true);
-            }
+    uint32_t deadline = keepAliveDeadlineMs();
+    Serial.printf("[Synergy] Options: keep-alive deadline %lu ms, relative moves %s, clipboard %s\n",
+                  (unsigned long)deadline, _options.relativeMouseMoves ? "on" : "off",
+                  _options.clipboardSharing ? "on" : "off");
+}
+
+// CIAK, CNOP - nothing to do
+void SynergyClient::handleIgnored(Client&, const uint8_t*, uint32_t) {
+}
+
+// EUNK - Error: Unknown client
+void SynergyClient::handleUnknownClient(Client&, const uint8_t*, uint32_t) {
+    Serial.printf("[Synergy] ERROR: Unknown client '%s' - add this screen name to server!\n", _clientName);
+    reset();  // Reset state so we can try again
+}
+
+// EBSY - Error: Server busy
+void SynergyClient::handleBusy(Client&, const uint8_t*, uint32_t) {
+    Serial.println("[Synergy] ERROR: Server busy");
+    reset();
+}
+
+// EBAD - Error: Bad/incompatible version
+void SynergyClient::handleBadVersion(Client&, const uint8_t*, uint32_t) {
+    Serial.println("[Synergy] ERROR: Incompatible protocol version");
+    reset();
+}
+
+uint32_t SynergyClient::fillRecvBuffer(Client& client) {
+    // Read straight into the free region of the ring, one burst per contiguous
+    // span (at most two when the free region wraps). read() returns <= 0 when
+    // the socket is empty, so no separate available() round-trip is needed.
+    // Returns the number of bytes added.
+    uint32_t total = 0;
+    while (recvFree() > 0) {
+        uint32_t head = _recvHead & RECV_MASK;
+        uint32_t span = SYNERGY_RECV_BUFFER_SIZE - head;
+        if (span > recvFree()) span = recvFree();
+        
+        int n = client.read(_recvBuffer + head, span);
+        if (n <= 0) {
+            _stats.emptyPolls++;
+            break;
         }
-        return;
+        _stats.socketReads++;
+        
+        _recvHead += (uint32_t)n;
+        _stats.bytesReceived += (uint32_t)n;
+        if (_rxMarkCount < SYNERGY_RX_MARKS) {
+            _rxMarks[_rxMarkCount].micros = latency::now();
+            _rxMarkCount++;
+        }
+        _rxMarks[_rxMarkCount - 1].end = _recvHead;
+        total += (uint32_t)n;
+        if ((uint32_t)n < span) break; // Socket drained
     }
-    
-    // CNOP - No-op (ignore)
-    if (memcmp(cmd, "CNOP", 4) == 0) {
-        return;
+    return total;
+}
+
+// When the read that delivered ring index start drained the socket. Reads
+// that ended before it are forgotten.
+uint32_t SynergyClient::frameArrival(uint32_t start) {
+    uint8_t done = 0;
+    while (done < _rxMarkCount && (int32_t)(_rxMarks[done].end - start) <= 0) done++;
+    if (done) {
+        _rxMarkCount -= done;
+        memmove(_rxMarks, _rxMarks + done, _rxMarkCount * sizeof(RxMark));
     }
-    
-    // EUNK - Error: Unknown client
-    if (memcmp(cmd, "EUNK", 4) == 0) {
-        Serial.printf("[Synergy] ERROR: Unknown client '%s' - add this screen name to server!\n", _clientName);
-        reset();  // Reset state so we can try again
-        return;
+    return _rxMarkCount ? _rxMarks[0].micros : latency::now();
+}
+
+void SynergyClient::peekRecv(uint32_t offset, uint8_t* dst, uint32_t len) const {
+    for (uint32_t i = 0; i < len; i++) {
+        dst[i] = _recvBuffer[(_recvTail + offset + i) & RECV_MASK];
     }
+}
+
+uint32_t SynergyClient::peekFrameLength() const {
+    uint8_t hdr[4];
+    peekRecv(0, hdr, 4);
+    return (uint32_t)netToNative32(hdr);
+}
+
+bool SynergyClient::beginOversized(uint32_t msgLen) {
+    // Frames too big for the ring are drained in bulk as they arrive. DCLP
+    // (the usual culprit) is streamed into the clipboard parser; anything
+    // else is dropped. Returns false until enough of the header is buffered.
+    if (recvUsed() < 8) return false;
     
-    // EBSY - Error: Server busy
-    if (memcmp(cmd, "EBSY", 4) == 0) {
-        Serial.println("[Synergy] ERROR: Server busy");
-        reset();
-        return;
+    _rxMicros = frameArrival(_recvTail);
+    uint32_t start = latency::now();
+    uint8_t cmd[4];
+    peekRecv(4, cmd, 4);
+    MessageId id = messageIdFor((uint32_t)netToNative32(cmd));
+    if (hasFeature(FEATURE_CLIPBOARD_CHUNKS) && id == MSG_DCLP) {
+        if (recvUsed() < DCLP_HEADER_SIZE) return false;
+        
+        uint8_t hdr[DCLP_HEADER_SIZE];
+        peekRecv(0, hdr, DCLP_HEADER_SIZE);
+        uint32_t dataLen = (uint32_t)netToNative32(hdr + 14);
+        uint32_t bodyLeft = msgLen - (DCLP_HEADER_SIZE - 4);
+        clipboardChunk(hdr[8], hdr[13], dataLen < bodyLeft ? dataLen : bodyLeft);
+        
+        _recvTail += DCLP_HEADER_SIZE;
+        _skipBytes = bodyLeft;
+        _skipToClipboard = true;
+    } else {
+        Serial.printf("[Synergy] Skipping oversized packet (%u bytes)\n", msgLen);
+        _recvTail += 4;
+        _skipBytes = msgLen;
+        _skipToClipboard = false;
     }
-    
-    // EBAD - Error: Bad/incompatible version
-    if (memcmp(cmd, "EBAD", 4) == 0) {
-        Serial.println("[Synergy] ERROR: Incompatible protocol version");
-        reset();
-        return;
+    _stats.messages++;
+    countMessage(id, msgLen + 4, start);
+    return true;
+}
+
+void SynergyClient::drainOversized() {
+    // Consume buffered bytes of the current oversized frame one contiguous
+    // ring span at a time, without copying.
+    uint32_t start = latency::now();
+    bool parsed = _skipToClipboard && _skipBytes > 0 && recvUsed() > 0;
+    while (_skipBytes > 0 && recvUsed() > 0) {
+        uint32_t tail = _recvTail & RECV_MASK;
+        uint32_t span = SYNERGY_RECV_BUFFER_SIZE - tail;
+        if (span > recvUsed()) span = recvUsed();
+        if (span > _skipBytes) span = _skipBytes;
+        
+        if (_skipToClipboard) clipboardFeed(_recvBuffer + tail, span);
+        _recvTail += span;
+        _skipBytes -= span;
+    }
+    if (parsed) _messageCounters[MSG_DCLP].handlerMicros += latency::now() - start;
+    if (_skipBytes == 0) _skipToClipboard = false;
+}
+
+const uint8_t* SynergyClient::frameView(uint32_t len) {
+    uint32_t start = _recvTail & RECV_MASK;
+    if (start + len <= SYNERGY_RECV_BUFFER_SIZE) {
+        // Contiguous - parse in place
+        return _recvBuffer + start;
     }
+    // Frame wraps around the end of the ring - linearize it
+    uint32_t first = SYNERGY_RECV_BUFFER_SIZE - start;
+    memcpy(_frameBuffer, _recvBuffer + start, first);
+    memcpy(_frameBuffer + first, _recvBuffer, len - first);
+    return _frameBuffer;
+}
+
+bool SynergyClient::processHello(Client& client, const uint8_t* msg, uint32_t len) {
+    // Format: [4-byte length][protocol name][2-byte major][2-byte minor]
+    uint32_t msgLen = len - 4;
+    if (msgLen < 11) {
+        Serial.println("[Synergy] Server hello too short");
+        return false;
+    }
+    
+    const uint8_t* payload = msg + 4;
     
-    // DCLP - Clipboard data (ignore, we don't support clipboard)
-    if (memcmp(cmd, "DCLP", 4) == 0) {
-        // Silently ignore clipboard data
-        return;
+    // Check for "Synergy", "Barrier", or "Deskflow" in payload
+    bool isSynergy = (memcmp(payload, "Synergy", 7) == 0);
+    bool isBarrier = (memcmp(payload, "Barrier", 7) == 0);
+    bool isDeskflow = (msgLen >= 12 && memcmp(payload, "Deskflow", 8) == 0);
+    
+    if (!isSynergy && !isBarrier && !isDeskflow) {
+        Serial.println("[Synergy] Invalid server hello");
+        return false;
     }
     
-    // DSOP - Set options (ignore)
-    if (memcmp(cmd, "DSOP", 4) == 0) {
-        return;
+    const char* proto = isDeskflow ? "Deskflow" : (isBarrier ? "Barrier" : "Synergy");
+    int nameLen = isDeskflow ? 8 : 7;
+    uint16_t major = netToNative16(payload + nameLen);
+    uint16_t minor = netToNative16(payload + nameLen + 2);
+    Serial.printf("[Synergy] Server hello: %s %d.%d\n", proto, major, minor);
+    
+    if (major != SYNERGY_PROTOCOL_MAJOR) {
+        Serial.println("[Synergy] Unsupported protocol major version");
+        return false;
     }
     
-    // Unknown packet (only log once per packet type to reduce spam)
-    char pktId[5] = {0};
-    memcpy(pktId, cmd, 4);
-    static char lastUnknown[5] = {0};
-    if (memcmp(pktId, lastUnknown, 4) != 0) {
-        Serial.println("[Synergy] Unknown packet: " + String(pktId));
-        memcpy(lastUnknown, pktId, 4);
+    // Servers talk to a client at the version it answers with, so answer with
+    // the highest minor both sides know. Servers older than 1.6 still work
+    // for input, but their single-frame DCLP is not understood.
+    uint16_t negotiated = minor < SYNERGY_PROTOCOL_MINOR ? minor : SYNERGY_PROTOCOL_MINOR;
+    if (negotiated < SYNERGY_PROTOCOL_MINOR_MIN) {
+        Serial.printf("[Synergy] Server predates %d.%d, clipboard disabled\n",
+                      SYNERGY_PROTOCOL_MAJOR, SYNERGY_PROTOCOL_MINOR_MIN);
     }
+    
+    // Send our hello response (WITH length prefix)
+    beginReply(client);
+    addString(proto);
+    addUInt16(SYNERGY_PROTOCOL_MAJOR);
+    addUInt16(negotiated);
+    addUInt32((uint32_t)strlen(_clientName));
+    addString(_clientName);
+    
+    // Sent immediately: the connection is only established once it's out
+    if (!queueReply() || !flushReplies(client)) return false;
+    
+    _hasReceivedHello = true;
+    _connected = true;
+    _serverProtocol = proto;
+    _protocolMinor = negotiated;
+    _features = featuresForMinor(negotiated);
+    Serial.printf("[Synergy] Connected as %s, protocol %d.%d (%s)\n", _clientName,
+                  SYNERGY_PROTOCOL_MAJOR, negotiated, featureNames(_features).c_str());
+    return true;
+}
+
+uint32_t SynergyClient::keepAliveDeadlineMs() const {
+    // 0 = no deadline (server too old for CALV, or heartbeats turned off)
+    if (!hasFeature(FEATURE_KEEPALIVE)) return 0;
+    uint32_t period = _options.hasHeartbeat ? _options.heartbeatMs : _keepAlivePeriodMs;
+    return period * _keepAliveMultiple;
+}
+
+DropReason SynergyClient::takeDropReason() {
+    DropReason reason = _dropReason;
+    _dropReason = DROP_NONE;
+    return reason;
+}
+
+void SynergyClient::dropConnection(DropReason reason) {
+    if (reason == DROP_KEEPALIVE) _stats.keepAliveTimeouts++;
+    else _stats.protocolErrors++;
+    reset();
+    _dropReason = reason;
 }
 
 bool SynergyClient::update(Client& client) {
@@ -313,88 +813,87 @@ bool SynergyClient::update(Client& client) {
         return false;
     }
     
-    // Skip remaining bytes from oversized packet
-    while (_skipBytes > 0 && client.available()) {
-        client.read(); // Discard byte
-        _skipBytes--;
-    }
-    if (_skipBytes > 0) {
-        return true; // Still skipping, wait for more data
+    uint32_t received = _stats.bytesReceived;
+    
+    // Pull everything the socket has into the ring. While an oversized frame
+    // is being drained, keep refilling so the whole transfer is consumed in
+    // bulk instead of stalling the frames queued behind it.
+    fillRecvBuffer(client);
+    drainOversized();
+    while (_skipBytes > 0 && fillRecvBuffer(client) > 0) {
+        drainOversized();
     }
     
-    // Read available data
-    while (client.available() && _recvOfs < SYNERGY_RECV_BUFFER_SIZE) {
-        _recvBuffer[_recvOfs++] = client.read();
+    // Any traffic counts as proof of life; the server sends CALV when idle
+    unsigned long now = millis();
+    if (_stats.bytesReceived != received) {
+        _lastReceiveMs = now;
+    } else if (_connected && keepAliveDeadlineMs() &&
+               now - _lastReceiveMs > keepAliveDeadlineMs()) {
+        Serial.printf("[Synergy] No keep-alive for %lu ms, dropping connection\n",
+                      (unsigned long)(now - _lastReceiveMs));
+        dropConnection(DROP_KEEPALIVE);
+        return false;
     }
     
-    // Handle initial hello - server sends length-prefixed "Synergy" or "Barrier" or "Deskflow"
-    // Format: [4-byte length][protocol name][2-byte major][2-byte minor]
-    if (!_hasReceivedHello && _recvOfs >= 4) {
-        uint32_t msgLen = netToNative32(_recvBuffer);
-        uint32_t totalLen = msgLen + 4;
-        
-        if (_recvOfs >= (int)totalLen && msgLen >= 11) {
-            const uint8_t* payload = _recvBuffer + 4;
-            
-            // Check for "Synergy", "Barrier", or "Deskflow" in payload
-            bool isSynergy = (memcmp(payload, "Synergy", 7) == 0);
-            bool isBarrier = (memcmp(payload, "Barrier", 7) == 0);
-            bool isDeskflow = (msgLen >= 12 && memcmp(payload, "Deskflow", 8) == 0);
-            
-            if (isSynergy || isBarrier || isDeskflow) {
-                const char* proto = isDeskflow ? "Deskflow" : (isBarrier ? "Barrier" : "Synergy");
-                int nameLen = isDeskflow ? 8 : 7;
-                uint16_t major = netToNative16(payload + nameLen);
-                uint16_t minor = netToNative16(payload + nameLen + 2);
-                Serial.printf("[Synergy] Server hello: %s %d.%d\n", proto, major, minor);
-                
-                // Send our hello response (WITH length prefix)
-                addString(proto);
-                addUInt16(SYNERGY_PROTOCOL_MAJOR);
-                addUInt16(SYNERGY_PROTOCOL_MINOR);
-                addUInt32((uint32_t)strlen(_clientName));
-                addString(_clientName);
-                
-                if (sendReply(client)) {
-                    _hasReceivedHello = true;
-                    _connected = true;
-                    Serial.println("[Synergy] Connected as " + String(_clientName));
-                }
-                
-                // Consume the hello message
-                memmove(_recvBuffer, _recvBuffer + totalLen, _recvOfs - totalLen);
-                _recvOfs -= totalLen;
-        }
-        }
+    if (_skipBytes > 0) {
+        return true; // Rest of the oversized frame hasn't arrived yet
     }
     
-    // Process length-prefixed messages (after hello)
-    while (_hasReceivedHello && _recvOfs >= 4) {
-        uint32_t msgLen = netToNative32(_recvBuffer);
+    // Extract complete length-prefixed frames. The server hello comes first
+    // (length-prefixed "Synergy", "Barrier" or "Deskflow"), then regular messages.
+    while (recvUsed() >= 4) {
+        uint32_t msgLen = peekFrameLength();
         uint32_t totalLen = msgLen + 4; // Include header
         
-        if (totalLen > SYNERGY_RECV_BUFFER_SIZE) {
-            // Oversized packet - skip it instead of disconnecting
-            // This happens with clipboard data (DCLP) which can be very large
-            _skipBytes = totalLen - _recvOfs; // How much more to skip
-            Serial.printf("[Synergy] Skipping oversized packet (%u bytes)\n", totalLen);
-            _recvOfs = 0; // Clear buffer, we'll skip the rest
-            break;
+        // A length the server could never send means we've lost framing (or
+        // aren't talking to a Synergy server); nothing after it can be trusted
+        uint32_t maxLen = _hasReceivedHello ? SYNERGY_MAX_MESSAGE_SIZE : SYNERGY_MAX_HELLO_SIZE;
+        if (msgLen > maxLen) {
+            Serial.printf("[Synergy] Bad frame length %u, dropping connection\n", (unsigned)msgLen);
+            dropConnection(DROP_PROTOCOL);
+            return false;
+        }
+        
+        if (msgLen > SYNERGY_MAX_FRAME_SIZE - 4) {
+            if (!beginOversized(msgLen)) break;
+            drainOversized();
+            if (_skipBytes > 0) break;
+            continue;
         }
         
-        if ((uint32_t)_recvOfs < totalLen) {
+        if (recvUsed() < totalLen) {
             // Incomplete message, wait for more data
             break;
         }
         
-        // Process this message
-        processMessage(client, _recvBuffer, totalLen);
+        // Consume before dispatch: handlers never touch the ring, and an
+        // error reply (EUNK etc.) may reset() the indices underneath us.
+        const uint8_t* frame = frameView(totalLen);
+        _rxMicros = frameArrival(_recvTail);
+        _recvTail += totalLen;
+        _stats.messages++;
         
-        // Move remaining data to front of buffer
-        memmove(_recvBuffer, _recvBuffer + totalLen, _recvOfs - totalLen);
-        _recvOfs -= totalLen;
+        if (!_hasReceivedHello) {
+            if (!processHello(client, frame, totalLen)) {
+                Serial.println("[Synergy] Handshake failed, dropping connection");
+                dropConnection(DROP_PROTOCOL);
+                return false;
+            }
+        } else {
+            processMessage(client, frame, totalLen);
+        }
     }
     
+    if (_screenInfoDirty && _connected) {
+        Serial.printf("[Synergy] Screen geometry changed, sending DINF %dx%d at %d,%d\n",
+                      _screen.width, _screen.height, _screen.x, _screen.y);
+        sendScreenInfo(client);
+    }
+    
+    // Send every reply staged while handling this batch in a single write
+    flushReplies(client);
+    
     return true;
 }
 
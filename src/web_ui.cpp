@@ -8,6 +8,8 @@
 #include "../include/device_name.h"
 #include "../include/ethernet_setup.h"
 #include "../include/ble_hid.h"
+#include "../include/deskflow_server.h"
+#include "../include/latency.h"
 #include <Ethernet.h>
 
 namespace web_ui {
@@ -67,6 +69,50 @@ void log(const String& line) {
     }
 }
 
+static String requestPath(const String& line) {
+    int firstSpace = line.indexOf(' ');
+    int secondSpace = line.indexOf(' ', firstSpace + 1);
+    if (firstSpace < 0 || secondSpace < 0) return String("/");
+    String path = line.substring(firstSpace + 1, secondSpace);
+    int qIdx = path.indexOf('?');
+    if (qIdx >= 0) path = path.substring(0, qIdx);
+    return path;
+}
+
+static void servePlainText(EthernetClient& client, const String& body) {
+    client.println("HTTP/1.1 200 OK");
+    client.println("Content-Type: text/plain; charset=utf-8");
+    client.println("Connection: close");
+    client.println();
+    client.print(body);
+    client.stop();
+}
+
+// Very small query parser: URL-decoded value of key in "a=1&b=2"
+static bool queryParam(const String& query, const char* key, String& out) {
+    String prefix = String(key) + "=";
+    int pos = 0;
+    while (pos < (int)query.length()) {
+        int amp = query.indexOf('&', pos);
+        if (amp < 0) amp = query.length();
+        if (query.substring(pos, pos + prefix.length()) == prefix) {
+            out = urlDecode(query.substring(pos + prefix.length(), amp));
+            out.trim();
+            return true;
+        }
+        pos = amp + 1;
+    }
+    return false;
+}
+
+// Integer form field within [lo, hi]
+static bool queryInt(const String& query, const char* key, long lo, long hi, long& out) {
+    String val;
+    if (!queryParam(query, key, val) || !val.length()) return false;
+    out = val.toInt();
+    return out >= lo && out <= hi;
+}
+
 static void handleRequestLine(const String& line) {
     // Expect something like: GET /?deskflow=... HTTP/1.1
     int firstSpace = line.indexOf(' ');
@@ -77,17 +123,9 @@ static void handleRequestLine(const String& line) {
     if (qIdx < 0) return;
     String query = path.substring(qIdx + 1);
 
-    // Very small query parser: deskflow=...
-    int keyPos = query.indexOf("deskflow=");
-    if (keyPos < 0) return;
-    String val = query.substring(keyPos + 9);
-    int amp = val.indexOf('&');
-    if (amp >= 0) val = val.substring(0, amp);
-
-    String newUrl = urlDecode(val);
-    newUrl.trim();
+    String newUrl;
     // Only log if URL actually changed
-    if (newUrl != _deskflowUrl) {
+    if (queryParam(query, "deskflow", newUrl) && newUrl != _deskflowUrl) {
         _deskflowUrl = newUrl;
         if (_deskflowUrl.length()) {
             log("Deskflow URL set to: " + _deskflowUrl);
@@ -95,6 +133,34 @@ static void handleRequestLine(const String& line) {
             log("Deskflow URL cleared");
         }
     }
+
+    // Screen form submits all four fields together
+    long x, y, w, h;
+    if (query.indexOf("scr_w=") >= 0) {
+        if (queryInt(query, "scr_x", INT16_MIN, INT16_MAX, x) &&
+            queryInt(query, "scr_y", INT16_MIN, INT16_MAX, y) &&
+            queryInt(query, "scr_w", 1, INT16_MAX, w) &&
+            queryInt(query, "scr_h", 1, INT16_MAX, h)) {
+            synergy::ScreenGeometry g;
+            g.x = (int16_t)x;
+            g.y = (int16_t)y;
+            g.width = (uint16_t)w;
+            g.height = (uint16_t)h;
+            deskflow::setScreenGeometry(g);
+        } else {
+            log("Invalid screen geometry ignored");
+        }
+    }
+    
+    String layoutName;
+    if (queryParam(query, "kbd", layoutName)) {
+        keyboard_layout::Layout layout;
+        if (keyboard_layout::fromName(layoutName, layout)) {
+            deskflow::setKeyboardLayout(layout);
+        } else {
+            log("Unknown keyboard layout ignored: " + layoutName);
+        }
+    }
 }
 
 void poll() {
@@ -115,6 +181,19 @@ void poll() {
         if (line.length() == 0) break; // end of headers
     }
 
+    // Per-command traffic counters
+    if (requestPath(firstLine) == "/messages") {
+        servePlainText(client, deskflow::messageReport());
+        return;
+    }
+    
+    // Input latency histograms; /latency?reset clears them after reporting
+    if (requestPath(firstLine) == "/latency") {
+        servePlainText(client, latency::report());
+        if (firstLine.indexOf("/latency?reset") >= 0) latency::reset();
+        return;
+    }
+
     String currentUrl = _deskflowUrl;
     if (!currentUrl.length()) {
         currentUrl = DEFAULT_DESKFLOW_URL;
@@ -144,7 +223,7 @@ void poll() {
     client.println(".info-row b { color: #00d4ff; }");
     client.println(".status-connected { color: #00ff88; }");
     client.println(".status-disconnected { color: #ff6b6b; }");
-    client.println("input[type=text] { width: 100%; padding: 10px; margin: 10px 0; border: 1px solid #0f3460; border-radius: 4px; background: #0f3460; color: #eee; font-size: 14px; }");
+    client.println("input[type=text], input[type=number] { width: 100%; padding: 10px; margin: 10px 0; border: 1px solid #0f3460; border-radius: 4px; background: #0f3460; color: #eee; font-size: 14px; }");
     client.println("button { background: #00d4ff; color: #1a1a2e; border: none; padding: 10px 20px; border-radius: 4px; cursor: pointer; font-weight: bold; }");
     client.println("button:hover { background: #00b8e6; }");
     client.println(".log-area { background: #0d1117; border: 1px solid #30363d; border-radius: 4px; padding: 15px; height: 400px; overflow-y: auto; font-family: 'Consolas', 'Monaco', monospace; font-size: 12px; line-height: 1.5; color: #c9d1d9; white-space: pre-wrap; word-wrap: break-word; }");
@@ -166,16 +245,84 @@ void poll() {
     client.print("<div class=\"info-row\"><b>BLE HID:</b> <span class=\"");
     client.print(ble_hid::isConnected() ? "status-connected\">Connected" : "status-disconnected\">Disconnected");
     client.println("</span></div>");
-    client.print("<div class=\"info-row\"><b>Deskflow Server:</b> "); client.print(currentUrl); client.println("</div>");
+    {
+        const ble_hid::KeyboardStats& kb = ble_hid::keyboardStats();
+        client.print("<div class=\"info-row\"><b>Keyboard reports:</b> ");
+        client.print(kb.nkro ? "N-key rollover, " : "six-key boot, ");
+        client.print(String(kb.reports) + " sent, " + String(kb.suppressed) + " unchanged (not sent), ");
+        client.print(String(kb.rolloverOverflows) + " held past six keys, ");
+        client.print(String(kb.forcedReleases) + " forced releases, ");
+        client.println(String(kb.modifierFixes) + " modifier corrections</div>");
+        const deskflow::KeyStats& ks = deskflow::keyStats();
+        client.print("<div class=\"info-row\"><b>Key repeat:</b> ");
+        client.print(String(ks.repeatsDropped) + " dropped, " + String(ks.repeatsForwarded) + " forwarded, ");
+        client.println("longest hold " + String(ks.longestHoldMs) + " ms, " + String(ks.strayReleases) + " stray releases</div>");
+    }
+    client.print("<div class=\"info-row\"><b>Deskflow Server:</b> ");
+    String endpoints = deskflow::endpointSummary();
+    client.print(endpoints.length() ? endpoints : currentUrl);
+    client.println("</div>");
+    client.print("<div class=\"info-row\"><b>Protocol:</b> "); client.print(deskflow::sessionSummary()); client.println("</div>");
+    {
+        const synergy::Stats& st = deskflow::protocolStats();
+        client.print("<div class=\"info-row\"><b>Synergy RX:</b> ");
+        client.print(String(st.messages) + " msgs, " + String(st.socketReads) + " socket reads (");
+        client.print(st.messages ? String((float)st.socketReads / st.messages, 2) : String("-"));
+        client.print(" reads/msg, " + String(st.emptyPolls) + " empty polls), " + String(st.malformed) + " malformed, ");
+        client.println(String(st.protocolErrors) + " protocol errors (<a href=\"/messages\">per command</a>)</div>");
+    }
+    {
+        const input_queue::Stats& q = deskflow::inputQueueStats();
+        client.print("<div class=\"info-row\"><b>Input queue:</b> ");
+        client.print(String(q.pushed) + " events, peak " + String(q.highWatermark) + "/" + String(INPUT_QUEUE_CAPACITY));
+        client.print(", " + String(q.coalesced) + " coalesced, " + String(q.overflows) + " overflowed");
+        client.println("</div>");
+    }
+    {
+        latency::Summary ble = latency::summary(latency::STAGE_BLE);
+        client.print("<div class=\"info-row\"><b>RX&rarr;BLE latency:</b> ");
+        client.print("p50 " + String(ble.p50) + " us, p99 " + String(ble.p99) + " us, max " + String(ble.max) + " us");
+        client.println(" (<a href=\"/latency\">details</a>)</div>");
+    }
     
     client.println("<h2 style=\"margin-top:20px\">Configuration</h2>");
     client.println("<form method=\"GET\" action=\"/\">");
-    client.println("<label for=\"deskflow\">Deskflow Server URL:</label>");
+    client.println("<label for=\"deskflow\">Deskflow Server URL (several comma-separated, in priority order):</label>");
     client.print("<input type=\"text\" id=\"deskflow\" name=\"deskflow\" value=\"");
     client.print(currentUrl);
     client.println("\">");
     client.println("<button type=\"submit\">Save</button>");
     client.println("</form>");
+    {
+        // Must match the controlled machine's resolution, or the server's
+        // edge detection and absolute moves are off
+        synergy::ScreenGeometry g = deskflow::screenGeometry();
+        client.println("<form method=\"GET\" action=\"/\" style=\"margin-top:20px\">");
+        client.println("<label>Screen (x, y, width, height):</label>");
+        client.print("<input type=\"number\" name=\"scr_x\" value=\""); client.print(g.x); client.println("\">");
+        client.print("<input type=\"number\" name=\"scr_y\" value=\""); client.print(g.y); client.println("\">");
+        client.print("<input type=\"number\" name=\"scr_w\" min=\"1\" value=\""); client.print(g.width); client.println("\">");
+        client.print("<input type=\"number\" name=\"scr_h\" min=\"1\" value=\""); client.print(g.height); client.println("\">");
+        client.println("<button type=\"submit\">Save</button>");
+        client.println("</form>");
+    }
+    {
+        // Characters are retyped for this layout; "scancode" forwards
+        // physical keys and relies on both sides using the same layout
+        keyboard_layout::Layout current = deskflow::keyboardLayout();
+        client.println("<form method=\"GET\" action=\"/\" style=\"margin-top:20px\">");
+        client.println("<label for=\"kbd\">Target keyboard layout:</label>");
+        client.println("<select id=\"kbd\" name=\"kbd\">");
+        for (uint8_t i = 0; i < keyboard_layout::LAYOUT_COUNT; i++) {
+            const char* name = keyboard_layout::name((keyboard_layout::Layout)i);
+            client.print("<option value=\""); client.print(name); client.print("\"");
+            if (i == current) client.print(" selected");
+            client.print(">"); client.print(name); client.println("</option>");
+        }
+        client.println("</select>");
+        client.println("<button type=\"submit\">Save</button>");
+        client.println("</form>");
+    }
     client.println("</div>");
     
     // Right panel - Terminal Log